@@ -13,15 +13,22 @@
 #pragma once
 
 #include "ami/include/ikvm_utils.hpp"
+#include "ikvm_preview.hpp"
+#include "ikvm_screenshot.hpp"
+#include "ikvm_video.hpp"
 
 #include <string.h>
 
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/spawn.hpp>
 #include <sdbusplus/asio/object_server.hpp>
 #include <sdbusplus/bus.hpp>
 #include <sdbusplus/message.hpp>
+#include <sdbusplus/message/native_types.hpp>
 #include <sdbusplus/server/interface.hpp>
 #include <sdbusplus/server/object.hpp>
 
+#include <chrono>
 #include <iostream>
 #include <map>
 
@@ -38,8 +45,35 @@ namespace fs = std::filesystem;
 class Interface
 {
   public:
-    /*@brief Interface constructor*/
-    Interface(sdbusplus::asio::object_server& objserver);
+    /*
+     * @brief Interface constructor
+     *
+     * @param[in] io        - Reference to the io_context serving D-Bus
+     * @param[in] objserver - Reference to the D-Bus object server
+     * @param[in] video     - Pointer to the V4L2 video device, nullptr when
+     *                        replaying a recording
+     * @param[in] writer    - Reference to the screenshot writer
+     * @param[in] previews  - Reference to the preview generator
+     */
+    Interface(boost::asio::io_context& io,
+              sdbusplus::asio::object_server& objserver, Video* video,
+              ScreenshotWriter& writer, PreviewGenerator& previews);
+
+    /*
+     * @brief dmabuf fd, buffer index, buffer generation, payload bytes,
+     *  sequence, width, height, pixel format and bounding-box of a frame
+     */
+    using frameExport =
+        std::tuple<sdbusplus::message::unix_fd, uint32_t, uint32_t, uint64_t,
+                   uint32_t, uint32_t, uint32_t, uint32_t,
+                   std::tuple<int32_t, int32_t, uint32_t, uint32_t>>;
+
+    /*@brief sealed memfd holding a screenshot and its size in bytes */
+    using screenshotExport = std::tuple<sdbusplus::message::unix_fd, uint64_t>;
+
+    /*@brief sealed memfd holding a preview, its size, width and height */
+    using previewExport =
+        std::tuple<sdbusplus::message::unix_fd, uint64_t, uint32_t, uint32_t>;
 
     /*@brief Wrapper function for Dbus Intefaraces */
     void addInterfaces();
@@ -47,6 +81,12 @@ class Interface
     /*@brief  adds dbus Intefarace for Screenshot*/
     void addScreenshotInterface();
 
+    /*@brief  adds dbus Intefarace for Video capture tuning*/
+    void addVideoInterface();
+
+    /*@brief  adds dbus Intefarace for the screen preview*/
+    void addPreviewInterface();
+
     /*
      * @brief Implementation of dbus method TriggerScreenshot
      *
@@ -56,8 +96,76 @@ class Interface
      */
     std::string TriggerScreenshot(int scrnshotReqType);
 
+    /*
+     * @brief Implementation of dbus method TriggerScreenshotFd; takes a
+     * screenshot like TriggerScreenshot without storing it on flash. The
+     * reply is sent once the capture thread took it, other D-Bus requests
+     * are served meanwhile.
+     *
+     * @param[in] yield - Coroutine of the method call
+     *
+     * @return sealed memfd with the jpeg of the screenshot and its size
+     */
+    screenshotExport TriggerScreenshotFd(boost::asio::yield_context yield);
+
+    /*
+     * @brief Implementation of dbus method GetPreview
+     *
+     * @return sealed memfd with the latest preview jpeg and its metadata
+     */
+    previewExport GetPreview();
+
+    /*
+     * @brief Implementation of dbus method GetFrame; the frame is leased to
+     * the caller until ReleaseFrame is called, the lease times out or the
+     * next frame is leased. Waits for the next frame without blocking
+     * other D-Bus requests when the latest one is back with the driver.
+     *
+     * @param[in] yield - Coroutine of the method call
+     *
+     * @return dmabuf of the latest captured frame and its metadata
+     */
+    frameExport GetFrame(boost::asio::yield_context yield);
+
   private:
+    /*@brief Longest wait for the capture thread to take a screenshot*/
+    static constexpr std::chrono::seconds screenshotTimeout{3};
+    /*@brief Longest wait for a frame to lease out*/
+    static constexpr std::chrono::seconds frameWaitTimeout{1};
+    /*@brief Delay between checks for a frame to lease out*/
+    static constexpr std::chrono::milliseconds framePollInterval{10};
+
+    /*
+     * @brief Names a video signal state for the SignalState property
+     *
+     * @param[in] state - State of the host video signal
+     *
+     * @return "Signal", "NoSignal" or "PoweredOff"
+     */
+    static std::string signalStateName(Video::SignalState state);
+
+    /*
+     * @brief Copies an image into a memfd sealed against any change
+     *
+     * @param[in] name  - Name of the memfd
+     * @param[in] image - Image data
+     *
+     * @return The memfd; throws SdBusError on failure
+     */
+    static int sealedMemfd(const char* name, const std::vector<char>& image);
+
+    /*
+     * @brief Closes a descriptor once the reply carrying it was sent
+     *
+     * @param[in] fd - Descriptor returned by the method
+     */
+    void closeAfterReply(int fd);
+
+    boost::asio::io_context& io;
     sdbusplus::asio::object_server& server;
+    Video* video;
+    ScreenshotWriter& screenshots;
+    PreviewGenerator& previews;
 };
 
 } // namespace ikvm
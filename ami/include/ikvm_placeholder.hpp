@@ -0,0 +1,85 @@
+/*
+ * ****************************************************************************
+ *
+ * KVM placeholder frames
+ * Filename : ikvm_placeholder.hpp
+ *
+ * @brief Preloaded NO SIGNAL / POWER OFF images sent in place of video
+ *
+ * ****************************************************************************
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ikvm
+{
+/*
+ * @class Placeholder
+ * @brief Holds a placeholder image in memory, read once from disk, and a
+ *        variant scaled to the current screen resolution
+ */
+class Placeholder
+{
+  public:
+    /*
+     * @brief Constructs Placeholder object; the image is read on first use
+     *
+     * @param[in] p - Path to the jpeg image
+     */
+    explicit Placeholder(const char* p);
+    ~Placeholder() = default;
+    Placeholder(const Placeholder&) = default;
+    Placeholder& operator=(const Placeholder&) = default;
+    Placeholder(Placeholder&&) = default;
+    Placeholder& operator=(Placeholder&&) = default;
+
+    /*
+     * @brief Gets the image as stored on disk
+     *
+     * @return jpeg data, empty if the image couldn't be read
+     */
+    const std::vector<char>& getImage();
+    /*
+     * @brief Gets the image fitted to a screen resolution, centered on
+     *        black. The last resolution asked for is cached.
+     *
+     * @param[in] width  - Width in pixels of the screen
+     * @param[in] height - Height in pixels of the screen
+     *
+     * @return jpeg data, empty if the image couldn't be read or scaled
+     */
+    const std::vector<char>& getFrame(size_t width, size_t height);
+
+  private:
+    /*
+     * @brief Decodes the image and encodes it fitted to the resolution
+     *
+     * @param[in] width  - Width in pixels of the screen
+     * @param[in] height - Height in pixels of the screen
+     *
+     * @return Boolean indicating if the scaled frame was encoded
+     */
+    bool scale(size_t width, size_t height);
+
+    /* @brief Path to the jpeg image */
+    const char* path;
+    /* @brief Indicates whether reading the image was attempted */
+    bool loaded;
+    /* @brief jpeg data as stored on disk */
+    std::vector<char> image;
+    /* @brief Width in pixels of the image */
+    size_t imageWidth;
+    /* @brief Height in pixels of the image */
+    size_t imageHeight;
+    /* @brief Width in pixels of the scaled frame */
+    size_t frameWidth;
+    /* @brief Height in pixels of the scaled frame */
+    size_t frameHeight;
+    /* @brief jpeg data fitted to the last resolution asked for */
+    std::vector<char> frame;
+};
+
+} // namespace ikvm
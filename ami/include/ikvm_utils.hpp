@@ -44,6 +44,10 @@ extern const std::string kvmObjPath;
 extern const std::string kvmServiceName;
 /*@brief screenshot interface name */
 extern const std::string scrnshotInterface;
+/*@brief video capture tuning interface name */
+extern const std::string videoInterface;
+/*@brief screen preview interface name */
+extern const std::string previewInterface;
 
 /*@brief required parameter for BSOD monitor */
 extern const std::string bsodObjPath;
@@ -57,8 +61,18 @@ extern std::atomic<bool> scrnshotFlag;
 extern const std::string bsodAsJpeg;
 extern const std::string bsodDir;
 
+/*@brief BSOD flag for saving the frames kept before the crash*/
+extern std::atomic<bool> bsodFlag;
+/*@brief Frame log of the frames kept before a BSOD, on tmpfs*/
+extern const std::string bsodFrameLog;
+extern const std::string frameLogDir;
+
 /*@brief pointer to Screenshot interface */
 extern std::shared_ptr<sdbusplus::asio::dbus_interface> kvmScrnshotIface;
+/*@brief pointer to Video capture tuning interface */
+extern std::shared_ptr<sdbusplus::asio::dbus_interface> kvmVideoIface;
+/*@brief pointer to screen preview interface */
+extern std::shared_ptr<sdbusplus::asio::dbus_interface> kvmPreviewIface;
 
 /*@brief set the time duration for session timeout*/
 extern std::chrono::duration<uint64_t> timeoutValue;
@@ -86,13 +100,22 @@ extern std::vector<uint8_t> activeSessionIDs;
 extern const std::string pwrStatService;
 extern const std::string pwrStatObjPath;
 extern const std::string pwrStatIface;
-/* @brief Holds the Host Power status
- *
- * @param[value] "Off": The host is powered off
- * @param[value] "On": The host is powered on
- * @param[value] "Unknown": The host power state is unknown
- */
-extern std::string hostPowerState;
+/* @brief Host Power status */
+enum class HostPower
+{
+    /* @brief The host power state is unknown */
+    Unknown,
+    /* @brief The host is powered off */
+    Off,
+    /* @brief The host is powered on */
+    On
+};
+/* @brief Holds the Host Power status, written from D-Bus and read by the
+ *        capture threads */
+extern std::atomic<HostPower> hostPowerState;
+/*@brief Incremented when the host powers on; every device set reprobes its
+ * video signal at once when it sees a new count */
+extern std::atomic<uint64_t> hostPowerOnCount;
 
 /*@brief NO SIGNAL image stored Path */
 extern const char* NO_SIGNAL_IMG_PATH;
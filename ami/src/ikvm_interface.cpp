@@ -12,15 +12,34 @@
  */
 #include "ami/include/ikvm_interface.hpp"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <cerrno>
+#include <memory>
+
 namespace ikvm
 {
-Interface::Interface(sdbusplus::asio::object_server& objserver) :
-    server(objserver)
+Interface::Interface(boost::asio::io_context& io,
+                     sdbusplus::asio::object_server& objserver, Video* video,
+                     ScreenshotWriter& writer, PreviewGenerator& previews) :
+    io(io), server(objserver), video(video), screenshots(writer),
+    previews(previews)
 {}
 
 void Interface::addInterfaces()
 {
     addScreenshotInterface();
+    addPreviewInterface();
+
+    if (video)
+    {
+        addVideoInterface();
+    }
 }
 
 void Interface::addScreenshotInterface()
@@ -36,9 +55,222 @@ void Interface::addScreenshotInterface()
             return Interface::TriggerScreenshot(scrnshotReqType);
         });
 
+    kvmScrnshotIface->register_method(
+        "TriggerScreenshotFd", [this](boost::asio::yield_context yield) {
+            return Interface::TriggerScreenshotFd(yield);
+        });
+
     kvmScrnshotIface->initialize();
 }
 
+void Interface::addVideoInterface()
+{
+    kvmVideoIface =
+        server.add_interface(kvmObjPath.c_str(), videoInterface.c_str());
+
+    kvmVideoIface->register_property(
+        "BufferCount", video->getBufferCount(),
+        [this](const uint32_t& req, uint32_t& old) {
+            video->setBufferCount(req);
+            // Applied between frames; the clamped request is reported
+            old = video->getRequestedBufferCount();
+            return 1;
+        },
+        [this](const uint32_t&) { return video->getBufferCount(); });
+
+    kvmVideoIface->register_property_r(
+        "BufferReason", video->getBufferReason(),
+        sdbusplus::vtable::property_::none,
+        [this](const std::string&) { return video->getBufferReason(); });
+
+    kvmVideoIface->register_property(
+        "TargetBitrate", video->getTargetBitrate(),
+        [this](const uint32_t& req, uint32_t& old) {
+            video->setTargetBitrate(req);
+            old = video->getTargetBitrate();
+            return 1;
+        },
+        [this](const uint32_t&) { return video->getTargetBitrate(); });
+
+    kvmVideoIface->register_property(
+        "Quality", video->getQuality(),
+        [this](const int32_t& req, int32_t& old) {
+            video->setQuality(req);
+            old = video->getRequestedQuality();
+            return 1;
+        },
+        [this](const int32_t&) { return video->getQuality(); });
+
+    kvmVideoIface->register_property(
+        "Subsampling", video->getSubsampling(),
+        [this](const int32_t& req, int32_t& old) {
+            video->setSubsampling(req);
+            old = video->getRequestedSubsampling();
+            return 1;
+        },
+        [this](const int32_t&) { return video->getSubsampling(); });
+
+    kvmVideoIface->register_property(
+        "AdaptiveSubsampling", video->getAdaptiveSubsampling(),
+        [this](const bool& req, bool& old) {
+            video->setAdaptiveSubsampling(req);
+            old = video->getAdaptiveSubsampling();
+            return 1;
+        },
+        [this](const bool&) { return video->getAdaptiveSubsampling(); });
+
+    kvmVideoIface->register_property(
+        "AdaptiveFrameRate", video->getAdaptiveFrameRate(),
+        [this](const bool& req, bool& old) {
+            video->setAdaptiveFrameRate(req);
+            old = video->getAdaptiveFrameRate();
+            return 1;
+        },
+        [this](const bool&) { return video->getAdaptiveFrameRate(); });
+
+    kvmVideoIface->register_property_r(
+        "CaptureRate", video->getCaptureRate(),
+        sdbusplus::vtable::property_::none,
+        [this](const int32_t&) { return video->getCaptureRate(); });
+
+    kvmVideoIface->register_property_r(
+        "DroppedFrames", video->getCounters().dropped,
+        sdbusplus::vtable::property_::none,
+        [this](const uint64_t&) { return video->getCounters().dropped; });
+
+    kvmVideoIface->register_property_r(
+        "ErrorFrames", video->getCounters().errors,
+        sdbusplus::vtable::property_::none,
+        [this](const uint64_t&) { return video->getCounters().errors; });
+
+    kvmVideoIface->register_property_r(
+        "TruncatedFrames", video->getCounters().truncated,
+        sdbusplus::vtable::property_::none,
+        [this](const uint64_t&) { return video->getCounters().truncated; });
+
+    kvmVideoIface->register_property_r(
+        "UnchangedFrames", video->getCounters().unchanged,
+        sdbusplus::vtable::property_::none,
+        [this](const uint64_t&) { return video->getCounters().unchanged; });
+
+    kvmVideoIface->register_property_r(
+        "SignalState", signalStateName(video->getSignalState()),
+        sdbusplus::vtable::property_::none,
+        [this](const std::string&) {
+            return signalStateName(video->getSignalState());
+        });
+
+    kvmVideoIface->register_method(
+        "GetFrame", [this](boost::asio::yield_context yield) {
+            return Interface::GetFrame(yield);
+        });
+
+    kvmVideoIface->register_method(
+        "ReleaseFrame", [this](uint32_t index, uint32_t generation) {
+            video->releaseExport(index, generation);
+        });
+
+    kvmVideoIface->register_property(
+        "AdaptiveBuffers", video->getAdaptiveBuffers(),
+        [this](const bool& req, bool& old) {
+            video->setAdaptiveBuffers(req);
+            old = video->getAdaptiveBuffers();
+            return 1;
+        },
+        [this](const bool&) { return video->getAdaptiveBuffers(); });
+
+    kvmVideoIface->initialize();
+}
+
+void Interface::addPreviewInterface()
+{
+    kvmPreviewIface =
+        server.add_interface(kvmObjPath.c_str(), previewInterface.c_str());
+
+    kvmPreviewIface->register_property(
+        "Enabled", previews.getEnabled(),
+        [this](const bool& req, bool& old) {
+            previews.setEnabled(req);
+            old = previews.getEnabled();
+            return 1;
+        },
+        [this](const bool&) { return previews.getEnabled(); });
+
+    kvmPreviewIface->register_property(
+        "Scale", previews.getScale(),
+        [this](const uint32_t& req, uint32_t& old) {
+            if (!previews.setScale(req))
+            {
+                throw sdbusplus::exception::SdBusError(
+                    EINVAL, "Scale must be 2, 4 or 8");
+            }
+            old = previews.getScale();
+            return 1;
+        },
+        [this](const uint32_t&) { return previews.getScale(); });
+
+    kvmPreviewIface->register_method("GetPreview", [this]() {
+        return Interface::GetPreview();
+    });
+
+    kvmPreviewIface->initialize();
+}
+
+std::string Interface::signalStateName(Video::SignalState state)
+{
+    switch (state)
+    {
+        case Video::SignalState::NoSignal:
+            return "NoSignal";
+        case Video::SignalState::PoweredOff:
+            return "PoweredOff";
+        default:
+            return "Signal";
+    }
+}
+
+Interface::frameExport Interface::GetFrame(boost::asio::yield_context yield)
+{
+    Video::ExportedFrame frame;
+    boost::asio::steady_timer timer(io);
+    auto deadline = std::chrono::steady_clock::now() + frameWaitTimeout;
+    boost::system::error_code ec;
+    int fd;
+
+    // The newest frame went back to the driver already; the capture thread
+    // keeps the next one, so poll for it without blocking the io_context
+    while ((fd = video->exportFrame(frame)) == -EAGAIN &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        timer.expires_after(framePollInterval);
+        timer.async_wait(yield[ec]);
+    }
+
+    if (fd == -EBUSY)
+    {
+        throw sdbusplus::exception::SdBusError(
+            EBUSY, "Too few video buffers to lease a frame");
+    }
+    if (fd < 0)
+    {
+        throw sdbusplus::exception::SdBusError(
+            ENODATA, "No exportable video frame available");
+    }
+
+    closeAfterReply(fd);
+
+    return {sdbusplus::message::unix_fd(fd),
+            frame.index,
+            frame.generation,
+            frame.payload,
+            frame.sequence,
+            static_cast<uint32_t>(frame.width),
+            static_cast<uint32_t>(frame.height),
+            frame.pixelformat,
+            std::make_tuple(frame.box.left, frame.box.top, frame.box.width,
+                            frame.box.height)};
+}
+
 std::string Interface::TriggerScreenshot(int scrnshotReqType)
 {
     std::string status = "Failure";
@@ -56,4 +288,133 @@ std::string Interface::TriggerScreenshot(int scrnshotReqType)
     return status;
 }
 
+Interface::screenshotExport
+    Interface::TriggerScreenshotFd(boost::asio::yield_context yield)
+{
+    auto timer = std::make_shared<boost::asio::steady_timer>(
+        io, screenshotTimeout);
+    auto image = std::make_shared<std::vector<char>>();
+    // Only read and written on the io_context
+    auto taken = std::make_shared<bool>(false);
+    boost::system::error_code ec;
+    uint64_t ticket;
+
+    // The capture thread takes the screenshot between two frames and hands
+    // it back through the io_context, waking this call up
+    ticket = screenshots.request(
+        [this, timer, image, taken](const std::vector<char>& jpeg) {
+            *image = jpeg;
+            boost::asio::post(io, [timer, taken]() {
+                *taken = true;
+                timer->cancel();
+            });
+        });
+    if (!ticket)
+    {
+        throw sdbusplus::exception::SdBusError(
+            EBUSY, "Too many screenshot requests pending");
+    }
+
+    timer->async_wait(yield[ec]);
+
+    // Timed out; unless the image is already on its way, nobody waits for
+    // it any more, so the capture must not be kept running for it
+    if (!*taken && !screenshots.cancel(ticket))
+    {
+        timer->expires_after(screenshotTimeout);
+        timer->async_wait(yield[ec]);
+    }
+
+    if (!*taken)
+    {
+        throw sdbusplus::exception::SdBusError(
+            ETIMEDOUT, "Timed out waiting for the screenshot");
+    }
+
+    if (image->empty())
+    {
+        throw sdbusplus::exception::SdBusError(ENODATA,
+                                               "No screenshot available");
+    }
+
+    int fd = sealedMemfd("ikvm-screenshot", *image);
+
+    closeAfterReply(fd);
+
+    return {sdbusplus::message::unix_fd(fd), image->size()};
+}
+
+Interface::previewExport Interface::GetPreview()
+{
+    std::vector<char> image;
+    uint32_t width;
+    uint32_t height;
+
+    if (!previews.get(image, width, height))
+    {
+        throw sdbusplus::exception::SdBusError(
+            ENODATA, previews.getEnabled() ? "No preview made yet"
+                                           : "Previews are not enabled");
+    }
+
+    int fd = sealedMemfd("ikvm-preview", image);
+
+    closeAfterReply(fd);
+
+    return {sdbusplus::message::unix_fd(fd), image.size(), width, height};
+}
+
+void Interface::closeAfterReply(int fd)
+{
+    // sd-bus duplicates the descriptor into the reply, which is sent as
+    // soon as the method returns and before this runs
+    boost::asio::post(io, [fd]() { close(fd); });
+}
+
+int Interface::sealedMemfd(const char* name, const std::vector<char>& image)
+{
+    size_t written = 0;
+    int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (fd < 0)
+    {
+        throw sdbusplus::exception::SdBusError(errno,
+                                               "Failed to create memfd");
+    }
+
+    while (written < image.size())
+    {
+        ssize_t rc = write(fd, image.data() + written, image.size() - written);
+
+        if (rc < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (rc <= 0)
+        {
+            int err = rc < 0 ? errno : EIO;
+
+            close(fd);
+            throw sdbusplus::exception::SdBusError(err,
+                                                   "Failed to write memfd");
+        }
+
+        written += rc;
+    }
+
+    // Receivers get exactly the jpeg, and nobody can change it afterwards
+    if (lseek(fd, 0, SEEK_SET) < 0 ||
+        fcntl(fd, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0)
+    {
+        int err = errno;
+
+        close(fd);
+        throw sdbusplus::exception::SdBusError(err, "Failed to seal memfd");
+    }
+
+    return fd;
+}
+
 } // namespace ikvm
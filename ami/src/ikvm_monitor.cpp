@@ -50,6 +50,7 @@ sdbusplus::bus::match_t Monitor::bsodErrorEventMonitor(
              */
             if (offset == 2)
             {
+                bsodFlag.store(true);
                 scrnshotFlag.store(true);
             }
         }
@@ -213,12 +214,16 @@ sdbusplus::bus::match_t
                     if (std::get<std::string>(entry.second).find("Off") !=
                         std::string::npos)
                     {
-                        hostPowerState = "Off";
+                        hostPowerState = HostPower::Off;
                     }
                     else if (std::get<std::string>(entry.second).find("On") !=
                              std::string::npos)
                     {
-                        hostPowerState = "On";
+                        if (hostPowerState.exchange(HostPower::On) !=
+                            HostPower::On)
+                        {
+                            hostPowerOnCount++;
+                        }
                     }
                 }
             }
@@ -0,0 +1,187 @@
+/*
+ * ****************************************************************************
+ *
+ * KVM placeholder frames
+ * Filename : ikvm_placeholder.cpp
+ *
+ * @brief Preloaded NO SIGNAL / POWER OFF images sent in place of video
+ *
+ * ****************************************************************************
+ */
+#include "ami/include/ikvm_placeholder.hpp"
+
+#include "ikvm_jpeg.hpp"
+
+#include <phosphor-logging/log.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace ikvm
+{
+
+using namespace phosphor::logging;
+
+Placeholder::Placeholder(const char* p) :
+    path(p), loaded(false), imageWidth(0), imageHeight(0), frameWidth(0),
+    frameHeight(0)
+{}
+
+const std::vector<char>& Placeholder::getImage()
+{
+    if (!loaded)
+    {
+        std::ifstream file(path, std::ios::binary);
+
+        loaded = true;
+        if (!file)
+        {
+            log<level::ERR>("Failed to open image file",
+                            entry("IMAGE_PATH=%s", path));
+            return image;
+        }
+
+        image.assign(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+    }
+
+    return image;
+}
+
+const std::vector<char>& Placeholder::getFrame(size_t width, size_t height)
+{
+    if (frameWidth != width || frameHeight != height)
+    {
+        frame.clear();
+        frameWidth = width;
+        frameHeight = height;
+
+        if (!getImage().empty() && !scale(width, height))
+        {
+            frame.clear();
+        }
+    }
+
+    return frame;
+}
+
+bool Placeholder::scale(size_t width, size_t height)
+{
+    jpeg_decompress_struct dinfo;
+    jpeg_compress_struct cinfo;
+    JpegError err;
+    std::vector<JSAMPLE> decoded;
+    std::vector<JSAMPLE> canvas;
+    unsigned char* out = nullptr;
+    unsigned long outSize = 0;
+    size_t fitWidth;
+    size_t fitHeight;
+    size_t left;
+    size_t top;
+
+    dinfo.err = jpegErrorManager(err, "Failed to scale placeholder image");
+    cinfo.err = dinfo.err;
+    jpeg_create_decompress(&dinfo);
+    jpeg_create_compress(&cinfo);
+
+    if (setjmp(err.jump))
+    {
+        jpeg_destroy_decompress(&dinfo);
+        jpeg_destroy_compress(&cinfo);
+        free(out);
+        return false;
+    }
+
+    jpeg_mem_src(&dinfo, (const unsigned char*)image.data(), image.size());
+    jpeg_read_header(&dinfo, TRUE);
+    imageWidth = dinfo.image_width;
+    imageHeight = dinfo.image_height;
+
+    if (imageWidth == width && imageHeight == height)
+    {
+        jpeg_destroy_decompress(&dinfo);
+        jpeg_destroy_compress(&cinfo);
+        frame = image;
+        return true;
+    }
+
+    // Fit the image into the screen keeping its aspect ratio
+    fitWidth = width;
+    fitHeight = imageHeight * width / imageWidth;
+    if (fitHeight > height)
+    {
+        fitHeight = height;
+        fitWidth = imageWidth * height / imageHeight;
+    }
+
+    // Let the decoder do most of a downscale, it only has to produce an
+    // eighth of the pixels for a 1/8 scale
+    dinfo.out_color_space = JCS_RGB;
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = 1;
+    while (dinfo.scale_denom < 8 &&
+           imageWidth / (dinfo.scale_denom * 2) >= fitWidth &&
+           imageHeight / (dinfo.scale_denom * 2) >= fitHeight)
+    {
+        dinfo.scale_denom *= 2;
+    }
+
+    jpeg_start_decompress(&dinfo);
+    decoded.resize((size_t)dinfo.output_width * dinfo.output_height * 3);
+    while (dinfo.output_scanline < dinfo.output_height)
+    {
+        JSAMPROW row =
+            &decoded[(size_t)dinfo.output_scanline * dinfo.output_width * 3];
+
+        jpeg_read_scanlines(&dinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&dinfo);
+
+    // Nearest-neighbour for the rest, centered on black
+    canvas.assign(width * height * 3, 0);
+    left = (width - fitWidth) / 2;
+    top = (height - fitHeight) / 2;
+    for (size_t y = 0; y < fitHeight; y++)
+    {
+        size_t sy = y * dinfo.output_height / fitHeight;
+        JSAMPLE* dst = &canvas[((top + y) * width + left) * 3];
+
+        for (size_t x = 0; x < fitWidth; x++)
+        {
+            size_t sx = x * dinfo.output_width / fitWidth;
+            const JSAMPLE* src = &decoded[(sy * dinfo.output_width + sx) * 3];
+
+            std::copy(src, src + 3, dst + x * 3);
+        }
+    }
+
+    jpeg_mem_dest(&cinfo, &out, &outSize);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 75, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = &canvas[(size_t)cinfo.next_scanline * width * 3];
+
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+
+    frame.assign((char*)out, (char*)out + outSize);
+
+    jpeg_destroy_decompress(&dinfo);
+    jpeg_destroy_compress(&cinfo);
+    free(out);
+
+    log<level::INFO>("Scaled placeholder image", entry("IMAGE_PATH=%s", path),
+                     entry("WIDTH=%zu", width), entry("HEIGHT=%zu", height));
+
+    return true;
+}
+
+} // namespace ikvm
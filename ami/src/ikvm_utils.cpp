@@ -23,6 +23,8 @@ const std::string kvmObjPath = "/xyz/openbmc_project/Kvm";
 const std::string kvmServiceName = "xyz.openbmc_project.Kvm";
 
 const std::string scrnshotInterface = "xyz.openbmc_project.Kvm.Screenshot";
+const std::string videoInterface = "xyz.openbmc_project.Kvm.Video";
+const std::string previewInterface = "xyz.openbmc_project.Kvm.Preview";
 
 const std::string bsodObjPath = "/xyz/openbmc_project/sensors/os/";
 const std::string bsodTarget = "/xyz/openbmc_project/sensors/os";
@@ -31,7 +33,13 @@ const std::string bsodSennType = "xyz.openbmc_project.Sensor.State";
 const std::string bsodAsJpeg = "/etc/bsod/screenShotBSOD.jpeg";
 const std::string bsodDir = "/etc/bsod";
 
+std::atomic<bool> bsodFlag{false};
+const std::string bsodFrameLog = "/run/ikvm/bsod.flog";
+const std::string frameLogDir = "/run/ikvm";
+
 std::shared_ptr<sdbusplus::asio::dbus_interface> kvmScrnshotIface = nullptr;
+std::shared_ptr<sdbusplus::asio::dbus_interface> kvmVideoIface = nullptr;
+std::shared_ptr<sdbusplus::asio::dbus_interface> kvmPreviewIface = nullptr;
 std::chrono::duration<uint64_t> timeoutValue =
     std::chrono::seconds(DEFAULT_TIMEOUT_VALUE);
 const std::string smgrService = "xyz.openbmc_project.SessionManager";
@@ -51,7 +59,8 @@ std::vector<uint8_t> activeSessionIDs;
 const std::string pwrStatService = "xyz.openbmc_project.State.Chassis";
 const std::string pwrStatObjPath = "/xyz/openbmc_project/state/chassis0";
 const std::string pwrStatIface = "xyz.openbmc_project.State.Chassis";
-std::string hostPowerState = "Unknown";
+std::atomic<HostPower> hostPowerState{HostPower::Unknown};
+std::atomic<uint64_t> hostPowerOnCount{0};
 
 const char* NO_SIGNAL_IMG_PATH = "/etc/NO_SIGNAL.jpg";
 const char* POWER_OFF_IMG_PATH = "/etc/POWER_OFF.jpg";
@@ -64,6 +73,7 @@ const char* POWER_OFF_IMG_PATH = "/etc/POWER_OFF.jpg";
 void createUtilities()
 {
     isDir(bsodDir);
+    isDir(frameLogDir);
     powerStatusInit();
     sessionTimeout();
 }
@@ -101,7 +111,7 @@ void powerStatusInit()
         if (reply.is_method_error())
         {
             log<level::ERR>("D-Bus method call error.");
-            hostPowerState = "Unknown";
+            hostPowerState = HostPower::Unknown;
             return;
         }
 
@@ -113,38 +123,38 @@ void powerStatusInit()
         {
             if (pws->find("Off") != std::string::npos)
             {
-                hostPowerState = "Off";
+                hostPowerState = HostPower::Off;
             }
             else if (pws->find("On") != std::string::npos)
             {
-                hostPowerState = "On";
+                hostPowerState = HostPower::On;
             }
             else
             {
-                hostPowerState = "Unknown";
+                hostPowerState = HostPower::Unknown;
                 log<level::ERR>("Unexpected power state");
             }
+
+            log<level::INFO>("[updated]",
+                             entry("hostPowerState: %s ", pws->c_str()));
         }
         else
         {
-            hostPowerState = "Unknown";
+            hostPowerState = HostPower::Unknown;
             log<level::ERR>("Unexpected variant type for power state.");
         }
-
-        log<level::INFO>("[updated]",
-                         entry("hostPowerState: %s ", hostPowerState.c_str()));
     }
     catch (const sdbusplus::exception::SdBusError& e)
     {
         log<level::ERR>(" D-Bus call Failed", entry("ERROR=%s", e.what()));
-        hostPowerState = "Unknown";
+        hostPowerState = HostPower::Unknown;
         return;
     }
     catch (const std::exception& e)
     {
         log<level::ERR>("Error handling for Host power state ",
                         entry("ERROR=%s", e.what()));
-        hostPowerState = "Unknown";
+        hostPowerState = HostPower::Unknown;
         return;
     }
 }
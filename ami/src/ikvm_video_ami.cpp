@@ -13,6 +13,7 @@
  * ****************************************************************************
  */
 #include "ami/include/ikvm_utils.hpp"
+#include "ikvm_crc.hpp"
 #include "ikvm_video.hpp"
 
 namespace ikvm
@@ -47,78 +48,105 @@ uint32_t Video::getSignalStatus()
 
 void Video::formatChange(int newformat)
 {
-    stop();
-    setFormat(newformat);
-    start();
+    requestedFormat = newformat;
+
+    if (fd < 0)
+    {
+        setFormat(newformat);
+    }
 }
 
-void Video::screenShot(const std::string& screenShotPath)
+void Video::placeholderFrame()
 {
-    if (buffersDone.front() < 0)
+    auto now = std::chrono::steady_clock::now();
+
+    // Only jpeg frames go out through the Tight jpeg path
+    if (pixelformat != V4L2_PIX_FMT_JPEG || now < nextPlaceholder)
+    {
+        return;
+    }
+
+    Placeholder& image = signalState == SignalState::PoweredOff
+                             ? powerOffImage
+                             : noSignalImage;
+    const std::vector<char>& data = image.getFrame(width, height);
+
+    // A frame that doesn't parse would be dropped as truncated
+    if (!parseJpeg(data.data(), data.size(), placeholderJpeg))
     {
-        log<level::ERR>("Buffer front empty");
         return;
     }
 
-    try
+    placeholder = &data;
+    placeholderCrc = -1;
+    if (hashing)
+    {
+        size_t skip = placeholderJpeg.scanOffset;
+
+        placeholderCrc = frameCrc(data.data() + skip, data.size() - skip);
+    }
+    nextPlaceholder = now + placeholderInterval;
+}
+
+bool Video::screenShot(std::vector<char>& image)
+{
+    uint32_t stat = getSignalStatus();
+
+    image.clear();
+
+    if (stat == UINT32_MAX)
+    {
+        log<level::ERR>("ERROR in getting HOST Signal status");
+        image = noSignalImage.getImage();
+    }
+    else if (stat == V4L2_IN_ST_NO_SIGNAL)
     {
-        std::ofstream screenshot(screenShotPath,
-                                 std::ios::out | std::ios::binary);
-        if (!screenshot)
+        if (hostPowerState == HostPower::Off)
         {
-            log<level::ERR>(" Failed to create destination file",
-                            entry("FILE_PATH=%s", screenShotPath.c_str()));
-            return;
+            image = powerOffImage.getImage();
+            log<level::INFO>("[screenshot] Host POWER OFF ");
         }
+        else
+        {
+            image = noSignalImage.getImage();
+            log<level::INFO>("[screenshot] Host NO SIGNAL ");
+        }
+    }
+    else if (format == 2)
+    {
+        VideoSource::Updates updates;
 
-        uint32_t stat = getSignalStatus();
-
-        // Lambda function to avoid boiler plate code
-        auto copyImageToScreenshot = [&](const std::string& imagePath) {
-            std::ifstream imageFile(imagePath, std::ios::binary);
-            if (imageFile)
-            {
-                screenshot << imageFile.rdbuf();
-                imageFile.close();
-            }
-            else
-            {
-                log<level::ERR>("Failed to open image file",
-                                entry("IMAGE_PATH=%s", imagePath.c_str()));
-            }
-        };
-
-        if (stat == UINT32_MAX)
+        // The frames still being composited are left out of the picture
+        if (keyframe.get(image, updates))
         {
-            log<level::ERR>("ERROR in getting HOST Signal status");
-            copyImageToScreenshot(NO_SIGNAL_IMG_PATH);
+            log<level::INFO>("[screenshot] Composited partial-jpeg frames");
         }
-        else if (stat == V4L2_IN_ST_NO_SIGNAL)
+    }
+    else if (buffersDone.empty())
+    {
+        log<level::ERR>("Buffer front empty");
+    }
+    else if (pixelformat != V4L2_PIX_FMT_JPEG)
+    {
+        log<level::ERR>("Screenshot needs jpeg frames");
+    }
+    else
+    {
+        auto& buff = buffers[buffersDone.front()];
+        const char* data = reinterpret_cast<char*>(buff.data);
+
+        // Only the jpeg up to its EOI marker, not the rest of the buffer
+        if (buff.jpeg.valid)
         {
-            if (hostPowerState == "Off")
-            {
-                copyImageToScreenshot(POWER_OFF_IMG_PATH);
-                log<level::INFO>("[screenshot] Host POWER OFF ");
-            }
-            else
-            {
-                copyImageToScreenshot(NO_SIGNAL_IMG_PATH);
-                log<level::INFO>("[screenshot] Host NO SIGNAL ");
-            }
+            image.assign(data, data + buff.jpeg.eoiOffset + 2);
+            log<level::INFO>("[screenshot] Host Video Stream Buffer ");
         }
         else
         {
-            auto& buff = buffers[buffersDone.front()];
-            screenshot.write(reinterpret_cast<char*>(buff.data), buff.size);
-            log<level::INFO>("[screenshot] Host Video Stream Buffer ");
+            log<level::ERR>("Screenshot frame is not a complete jpeg");
         }
-
-        screenshot.close();
-    }
-    catch (const std::exception& e)
-    {
-        log<level::ERR>("Error in handling screenshot ",
-                        entry("ERROR=%s", e.what()));
     }
+
+    return !image.empty();
 }
 } // namespace ikvm
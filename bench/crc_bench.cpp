@@ -0,0 +1,105 @@
+/*
+ * Checks frameCrc against boost::crc_32_type, which the RFB server used to
+ * hash frames with, and times both on a frame-sized buffer.
+ * Run with `meson test --benchmark`.
+ */
+#include "ikvm_crc.hpp"
+
+#include <boost/crc.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace ikvm;
+
+/* @brief Bytes of a typical 1024x768 jpeg frame */
+static constexpr size_t frameSize = 400 * 1024;
+/* @brief Frames hashed per timing run */
+static constexpr int iterations = 200;
+
+static uint32_t boostCrc(const char* data, size_t size)
+{
+    boost::crc_32_type crc;
+
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+/*
+ * @brief Compares frameCrc with boost over lengths and alignments that
+ *        exercise the 8-byte loop and the byte tails
+ *
+ * @return Boolean indicating if every checksum matched
+ */
+static bool checkEquivalence(const std::vector<char>& data)
+{
+    const size_t sizes[] = {0, 1, 3, 4, 7, 8, 9, 15, 63, 1000, frameSize - 8};
+
+    for (size_t size : sizes)
+    {
+        for (size_t offset = 0; offset < 8; offset++)
+        {
+            const char* p = data.data() + offset;
+
+            if (frameCrc(p, size) != boostCrc(p, size))
+            {
+                fprintf(stderr, "Mismatch: size %zu offset %zu\n", size,
+                        offset);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * @brief Times a checksum over the frame, starting past a jpeg header as
+ *        the server does
+ *
+ * @return Microseconds per frame
+ */
+template <typename Function>
+static double timeCrc(const std::vector<char>& data, Function crc)
+{
+    volatile uint32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; i++)
+    {
+        sink = sink ^ crc(data.data() + 623, data.size() - 623);
+    }
+
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - start)
+               .count() /
+           iterations;
+}
+
+int main()
+{
+    std::mt19937 random(1);
+    std::vector<char> data(frameSize);
+
+    for (auto& c : data)
+    {
+        c = (char)random();
+    }
+
+    if (!checkEquivalence(data))
+    {
+        return 1;
+    }
+
+    double boost = timeCrc(data, boostCrc);
+    double fast = timeCrc(data, frameCrc);
+
+    printf("frameCrc (%s) matches boost::crc_32_type\n",
+           frameCrcImplementation());
+    printf("%zu KB frame: boost %.1f us, frameCrc %.1f us, %.1fx\n",
+           frameSize / 1024, boost, fast, boost / fast);
+
+    return 0;
+}
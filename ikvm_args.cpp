@@ -8,17 +8,24 @@
 namespace ikvm
 {
 Args::Args(int argc, char* argv[]) :
-    frameRate(30), subsampling(0), format(0), calcFrameCRC{false},
-    commandLine(argc, argv)
+    frameRate(30), subsampling(0), format(0), bufferCount(3),
+    adaptiveBuffers(false), quality(-1), targetBitrate(0),
+    adaptiveFrameRate(false), replayRate(0), keepSeconds(0),
+    keepMegabytes(8), calcFrameCRC{false}, commandLine(argc, argv)
 {
     int option;
-    const char* opts = "f:s:m:h:k:p:u:v:c";
+    const char* opts = "f:s:m:h:k:p:u:v:cb:aq:t:gr:R:w:F:M:";
     struct option lopts[] = {
-        {"frameRate", 1, 0, 'f'}, {"subsampling", 1, 0, 's'},
-        {"format", 1, 0, 'm'},    {"help", 0, 0, 'h'},
-        {"keyboard", 1, 0, 'k'},  {"mouse", 1, 0, 'p'},
-        {"udcName", 1, 0, 'u'},   {"videoDevice", 1, 0, 'v'},
-        {"calcCRC", 0, 0, 'c'},   {0, 0, 0, 0}};
+        {"frameRate", 1, 0, 'f'},     {"subsampling", 1, 0, 's'},
+        {"format", 1, 0, 'm'},        {"help", 0, 0, 'h'},
+        {"keyboard", 1, 0, 'k'},      {"mouse", 1, 0, 'p'},
+        {"udcName", 1, 0, 'u'},       {"videoDevice", 1, 0, 'v'},
+        {"calcCRC", 0, 0, 'c'},       {"buffers", 1, 0, 'b'},
+        {"adaptBuffers", 0, 0, 'a'},  {"quality", 1, 0, 'q'},
+        {"targetBitrate", 1, 0, 't'}, {"adaptFrameRate", 0, 0, 'g'},
+        {"replay", 1, 0, 'r'},        {"replayRate", 1, 0, 'R'},
+        {"record", 1, 0, 'w'},        {"keepSeconds", 1, 0, 'F'},
+        {"keepMegabytes", 1, 0, 'M'}, {0, 0, 0, 0}};
 
     while ((option = getopt_long(argc, argv, opts, lopts, NULL)) != -1)
     {
@@ -31,32 +38,74 @@ Args::Args(int argc, char* argv[]) :
                 break;
             case 's':
                 subsampling = (int)strtol(optarg, NULL, 0);
-                if (subsampling < 0 || subsampling > 1)
+                if (subsampling < 0 || subsampling > 2)
                     subsampling = 0;
                 break;
             case 'm':
                 format = (int)strtol(optarg, NULL, 0);
-                if (format != 0 && format != 2)
+                if (format != 0 && format != 2 && format != 3)
                     format = 0;
                 break;
             case 'h':
                 printUsage();
                 exit(0);
             case 'k':
-                keyboardPath = std::string(optarg);
+                keyboardPaths.emplace_back(optarg);
                 break;
             case 'p':
-                pointerPath = std::string(optarg);
+                pointerPaths.emplace_back(optarg);
                 break;
             case 'u':
-                udcName = std::string(optarg);
+                udcNames.emplace_back(optarg);
                 break;
             case 'v':
-                videoPath = std::string(optarg);
+                videoPaths.emplace_back(optarg);
                 break;
             case 'c':
                 calcFrameCRC = true;
                 break;
+            case 'b':
+                bufferCount = (int)strtol(optarg, NULL, 0);
+                if (bufferCount < 2 || bufferCount > 8)
+                    bufferCount = 3;
+                break;
+            case 'a':
+                adaptiveBuffers = true;
+                break;
+            case 'q':
+                quality = (int)strtol(optarg, NULL, 0);
+                if (quality < 0 || quality > 100)
+                    quality = -1;
+                break;
+            case 't':
+                targetBitrate = (int)strtol(optarg, NULL, 0);
+                if (targetBitrate < 0)
+                    targetBitrate = 0;
+                break;
+            case 'g':
+                adaptiveFrameRate = true;
+                break;
+            case 'r':
+                replayPath = std::string(optarg);
+                break;
+            case 'R':
+                replayRate = (int)strtol(optarg, NULL, 0);
+                if (replayRate < 0)
+                    replayRate = 0;
+                break;
+            case 'w':
+                recordPath = std::string(optarg);
+                break;
+            case 'F':
+                keepSeconds = (int)strtol(optarg, NULL, 0);
+                if (keepSeconds < 0 || keepSeconds > 60)
+                    keepSeconds = 10;
+                break;
+            case 'M':
+                keepMegabytes = (int)strtol(optarg, NULL, 0);
+                if (keepMegabytes < 1 || keepMegabytes > 64)
+                    keepMegabytes = 8;
+                break;
         }
     }
 }
@@ -67,17 +116,42 @@ void Args::printUsage()
     fprintf(stderr, "OpenBMC IKVM daemon\n");
     fprintf(stderr, "Usage: obmc-ikvm [options]\n");
     fprintf(stderr, "-f frame rate          try this frame rate\n");
-    fprintf(stderr, "-s subsampling         try this subsampling\n");
-    fprintf(stderr, "-m format              try this format\n");
+    fprintf(stderr, "-s subsampling         try this subsampling (0: 444, "
+                    "1: 420, 2: adaptive)\n");
+    fprintf(stderr, "-m format              try this format (0: jpeg, "
+                    "2: partial jpeg, 3: hextile)\n");
     fprintf(stderr, "-h, --help             show this message and exit\n");
     fprintf(stderr, "-k device              HID keyboard gadget device\n");
     fprintf(stderr, "-p device              HID mouse gadget device\n");
     fprintf(stderr,
             "-u udc name            UDC that HID gadget will connect to\n");
     fprintf(stderr, "-v device              V4L2 device\n");
+    fprintf(stderr, "                       -v, -k, -p and -u repeat per "
+                    "device set; set N\n");
+    fprintf(stderr, "                       listens on rfbport + N\n");
     fprintf(
         stderr,
         "-c, --calcCRC          Calculate CRC for each frame to save bandwidth\n");
+    fprintf(stderr, "-b buffers             number of video buffers (2-8)\n");
+    fprintf(stderr,
+            "-a, --adaptBuffers     adapt video buffers to dropped frames\n");
+    fprintf(stderr, "-q quality             initial jpeg quality\n");
+    fprintf(stderr,
+            "-t kbps                steer jpeg quality to this bitrate\n");
+    fprintf(stderr,
+            "-g, --adaptFrameRate   lower the frame rate on idle screens\n");
+    fprintf(stderr,
+            "-r path                replay a frame log or jpeg directory\n");
+    fprintf(stderr,
+            "-R rate                replay frame rate (0: unthrottled)\n");
+    fprintf(stderr,
+            "-w path                record captured jpeg frames to a log\n");
+    fprintf(stderr, "-F seconds             frames kept for a host crash, "
+                    "captured at 2 fps\n");
+    fprintf(stderr, "                       without viewers (default 0: "
+                    "none)\n");
+    fprintf(stderr, "-M megabytes           memory for frames kept for a "
+                    "host crash\n");
     rfbUsage();
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 namespace ikvm
 {
@@ -88,44 +90,164 @@ class Args
         return format;
     }
 
+    /*
+     * @brief Get the number of video streaming buffers
+     *
+     * @return Value of the video buffer ring depth
+     */
+    inline int getBufferCount() const
+    {
+        return bufferCount;
+    }
+
+    /*
+     * @brief Get the adaptive video buffering setting
+     *
+     * @return True if the buffer ring depth adapts to dropped frames
+     */
+    inline bool getAdaptiveBuffers() const
+    {
+        return adaptiveBuffers;
+    }
+
+    /*
+     * @brief Get the initial jpeg quality
+     *
+     * @return Value of the jpeg quality, -1 for the driver default
+     */
+    inline int getQuality() const
+    {
+        return quality;
+    }
+
+    /*
+     * @brief Get the target bitrate of the video stream
+     *
+     * @return Target bitrate in kilobits per second, 0 if disabled
+     */
+    inline int getTargetBitrate() const
+    {
+        return targetBitrate;
+    }
+
+    /*
+     * @brief Get the adaptive capture frame rate setting
+     *
+     * @return True if the capture rate is lowered while the screen is idle
+     */
+    inline bool getAdaptiveFrameRate() const
+    {
+        return adaptiveFrameRate;
+    }
+
+    /*
+     * @brief Get the path to the recorded frames to replay
+     *
+     * @return Reference to the string storing the path, empty to capture
+     *         from the V4L2 device
+     */
+    inline const std::string& getReplayPath() const
+    {
+        return replayPath;
+    }
+
+    /*
+     * @brief Get the frame rate recorded frames are replayed at
+     *
+     * @return Frames per second, 0 for unthrottled
+     */
+    inline int getReplayRate() const
+    {
+        return replayRate;
+    }
+
+    /*
+     * @brief Get the path to record the captured frames to
+     *
+     * @return Reference to the string storing the path of the frame log,
+     *         empty to not record
+     */
+    inline const std::string& getRecordPath() const
+    {
+        return recordPath;
+    }
+
+    /*
+     * @brief Get the capture time span of the frames kept for a host crash
+     *
+     * @return Seconds of frames to keep, 0 to keep none
+     */
+    inline int getKeepSeconds() const
+    {
+        return keepSeconds;
+    }
+
+    /*
+     * @brief Get the most memory the frames kept for a host crash may take
+     *
+     * @return Megabytes of frame data to keep at most
+     */
+    inline int getKeepMegabytes() const
+    {
+        return keepMegabytes;
+    }
+
+    /*
+     * @brief Get the number of video/HID device sets to serve
+     *
+     * @return Number of video devices given, at least one
+     */
+    inline unsigned int getHeadCount() const
+    {
+        return std::max<size_t>(videoPaths.size(), 1);
+    }
+
     /*
      * @brief Get the path to the USB keyboard device
      *
+     * @param[in] head - Index of the device set
+     *
      * @return Reference to the string storing the path to the keyboard device
      */
-    inline const std::string& getKeyboardPath() const
+    inline const std::string& getKeyboardPath(unsigned int head = 0) const
     {
-        return keyboardPath;
+        return head < keyboardPaths.size() ? keyboardPaths[head] : none;
     }
 
     /*
      * @brief Get the path to the USB mouse device
      *
+     * @param[in] head - Index of the device set
+     *
      * @return Reference to the string storing the path to the mouse device
      */
-    inline const std::string& getPointerPath() const
+    inline const std::string& getPointerPath(unsigned int head = 0) const
     {
-        return pointerPath;
+        return head < pointerPaths.size() ? pointerPaths[head] : none;
     }
 
     /*
      * @brief Get the name of UDC
      *
+     * @param[in] head - Index of the device set
+     *
      * @return Reference to the string storing the name of UDC
      */
-    inline const std::string& getUdcName() const
+    inline const std::string& getUdcName(unsigned int head = 0) const
     {
-        return udcName;
+        return head < udcNames.size() ? udcNames[head] : none;
     }
 
     /*
      * @brief Get the path to the V4L2 video device
      *
+     * @param[in] head - Index of the device set
+     *
      * @return Reference to the string storing the path to the video device
      */
-    inline const std::string& getVideoPath() const
+    inline const std::string& getVideoPath(unsigned int head = 0) const
     {
-        return videoPath;
+        return head < videoPaths.size() ? videoPaths[head] : none;
     }
 
     /*
@@ -147,19 +269,41 @@ class Args
      *        stream
      */
     int frameRate;
-    /* @brief Desired subsampling (0: 444, 1: 420) */
+    /* @brief Desired subsampling (0: 444, 1: 420, 2: adaptive) */
     int subsampling;
-    /* @brief Desired capture format (0: standard jpeg, 1: reserved, 2: partial
-     * jpeg) */
+    /* @brief Desired capture format (0: standard jpeg, 1: aspeed jpeg, only
+     * negotiated with clients, 2: partial jpeg, 3: NPCM hextile) */
     int format;
-    /* @brief Path to the USB keyboard device */
-    std::string keyboardPath;
-    /* @brief Path to the USB mouse device */
-    std::string pointerPath;
-    /* @brief Name of UDC */
-    std::string udcName;
-    /* @brief Path to the V4L2 video device */
-    std::string videoPath;
+    /* @brief Desired number of video streaming buffers */
+    int bufferCount;
+    /* @brief Adapt the video buffer ring depth to dropped frames */
+    bool adaptiveBuffers;
+    /* @brief Initial jpeg quality (-1: driver default) */
+    int quality;
+    /* @brief Target bitrate in kilobits per second (0: disabled) */
+    int targetBitrate;
+    /* @brief Lower the capture frame rate while the screen is idle */
+    bool adaptiveFrameRate;
+    /* @brief Frames per second to replay at (0: unthrottled) */
+    int replayRate;
+    /* @brief Path to the recorded frames to replay */
+    std::string replayPath;
+    /* @brief Path to the frame log to record to */
+    std::string recordPath;
+    /* @brief Seconds of frames kept for a host crash (0: disabled) */
+    int keepSeconds;
+    /* @brief Megabytes of frames kept for a host crash at most */
+    int keepMegabytes;
+    /* @brief Paths to the USB keyboard devices, one per device set */
+    std::vector<std::string> keyboardPaths;
+    /* @brief Paths to the USB mouse devices, one per device set */
+    std::vector<std::string> pointerPaths;
+    /* @brief Names of UDC, one per device set */
+    std::vector<std::string> udcNames;
+    /* @brief Paths to the V4L2 video devices, one per device set */
+    std::vector<std::string> videoPaths;
+    /* @brief Empty path of a device not given for a device set */
+    std::string none;
     /* @brief Identical frames detection */
     bool calcFrameCRC;
     /* @brief Original command line arguments passed to the application */
@@ -0,0 +1,61 @@
+#include "ikvm_chroma_policy.hpp"
+
+#include <algorithm>
+
+namespace ikvm
+{
+ChromaPolicy::ChromaPolicy() :
+    changedSum(0), frames(0), quietWindows(0), windowConstrained(false)
+{}
+
+void ChromaPolicy::reset()
+{
+    changedSum = 0;
+    frames = 0;
+    quietWindows = 0;
+    windowConstrained = false;
+}
+
+int ChromaPolicy::update(unsigned int changed, bool constrained,
+                         int frameRate, int subsampling)
+{
+    unsigned int average;
+
+    changedSum += std::min(changed, 1000u);
+    windowConstrained |= constrained;
+
+    if (++frames < windowSeconds * std::max(frameRate, 1))
+    {
+        return subsampling;
+    }
+
+    average = changedSum / frames;
+    changedSum = 0;
+    frames = 0;
+
+    // Drop to 4:2:0 as soon as a window is busy, but only go back to 4:4:4
+    // after several quiet ones so scrolling text or a blinking cursor
+    // doesn't flip the subsampling back and forth
+    if (windowConstrained || average > busyChange)
+    {
+        windowConstrained = false;
+        quietWindows = 0;
+        return 1;
+    }
+
+    if (average < staticChange)
+    {
+        if (++quietWindows >= staticWindows)
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        quietWindows = 0;
+    }
+
+    return subsampling;
+}
+
+} // namespace ikvm
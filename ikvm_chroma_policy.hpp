@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ikvm
+{
+/*
+ * @class ChromaPolicy
+ * @brief Picks the jpeg chroma subsampling from the screen activity: 4:4:4
+ *        keeps the text of static screens readable, 4:2:0 saves bandwidth
+ *        while the screen is busy or the link can't keep up
+ */
+class ChromaPolicy
+{
+  public:
+    ChromaPolicy();
+    ~ChromaPolicy() = default;
+    ChromaPolicy(const ChromaPolicy&) = default;
+    ChromaPolicy& operator=(const ChromaPolicy&) = default;
+    ChromaPolicy(ChromaPolicy&&) = default;
+    ChromaPolicy& operator=(ChromaPolicy&&) = default;
+
+    /*
+     * @brief Accounts a sent frame and picks the subsampling for the next ones
+     *
+     * @param[in] changed     - Changed part of the screen in 1/1000ths
+     * @param[in] constrained - Whether the bandwidth is too tight to afford
+     *                          4:4:4
+     * @param[in] frameRate   - Frame rate of the video stream
+     * @param[in] subsampling - Current subsampling, 1:420/0:444
+     *
+     * @return Subsampling to use for the next frames, 1:420/0:444
+     */
+    int update(unsigned int changed, bool constrained, int frameRate,
+               int subsampling);
+
+    /* @brief Forgets the activity gathered so far */
+    void reset();
+
+  private:
+    /* @brief Seconds of frames over which the activity is averaged */
+    static constexpr unsigned int windowSeconds = 2;
+    /* @brief Average change in 1/1000ths above which the screen is busy */
+    static constexpr unsigned int busyChange = 250;
+    /* @brief Average change in 1/1000ths below which the screen is static */
+    static constexpr unsigned int staticChange = 20;
+    /* @brief Consecutive static windows before switching to 4:4:4 */
+    static constexpr unsigned int staticWindows = 3;
+
+    /* @brief Sum of the changed parts of the frames in this window */
+    uint64_t changedSum;
+    /* @brief Frames sent in this window */
+    unsigned int frames;
+    /* @brief Consecutive windows the screen was static */
+    unsigned int quietWindows;
+    /* @brief Whether any frame in this window was bandwidth constrained */
+    bool windowConstrained;
+};
+
+} // namespace ikvm
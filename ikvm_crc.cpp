@@ -0,0 +1,156 @@
+#include "ikvm_crc.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace ikvm
+{
+
+/* @brief CRC-32 update over a run of bytes, without pre and post inversion */
+using CrcFunction = uint32_t (*)(uint32_t crc, const uint8_t* data,
+                                 size_t size);
+
+/* @brief Reflected form of the CRC-32 polynomial 0x04C11DB7 */
+static constexpr uint32_t crcPolynomial = 0xEDB88320;
+
+static constexpr std::array<std::array<uint32_t, 256>, 8> makeCrcTables()
+{
+    std::array<std::array<uint32_t, 256>, 8> tables{};
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ crcPolynomial : crc >> 1;
+        }
+        tables[0][i] = crc;
+    }
+
+    // Table k advances the CRC of a byte by k more zero bytes
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        for (int k = 1; k < 8; k++)
+        {
+            uint32_t prev = tables[k - 1][i];
+
+            tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+        }
+    }
+
+    return tables;
+}
+
+static constexpr auto crcTables = makeCrcTables();
+
+static uint32_t crc32Slicing8(uint32_t crc, const uint8_t* data, size_t size)
+{
+    const auto& t = crcTables;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Eight table lookups per eight bytes instead of eight dependent ones
+    while (size >= 8)
+    {
+        uint32_t lo;
+        uint32_t hi;
+
+        memcpy(&lo, data, 4);
+        memcpy(&hi, data + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^
+              t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^ t[3][hi & 0xFF] ^
+              t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        data += 8;
+        size -= 8;
+    }
+#endif
+
+    while (size--)
+    {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    }
+
+    return crc;
+}
+
+#if defined(__aarch64__) || defined(__ARM_FEATURE_CRC32)
+#if defined(__aarch64__)
+__attribute__((target("+crc")))
+#endif
+static uint32_t crc32Armv8(uint32_t crc, const uint8_t* data, size_t size)
+{
+    while (size >= 8)
+    {
+        uint64_t v;
+
+        memcpy(&v, data, 8);
+        crc = __crc32d(crc, v);
+        data += 8;
+        size -= 8;
+    }
+
+    if (size >= 4)
+    {
+        uint32_t v;
+
+        memcpy(&v, data, 4);
+        crc = __crc32w(crc, v);
+        data += 4;
+        size -= 4;
+    }
+
+    while (size--)
+    {
+        crc = __crc32b(crc, *data++);
+    }
+
+    return crc;
+}
+#endif
+
+/*
+ * @struct CrcImplementation
+ * @brief CRC-32 implementation picked once for the CPU
+ */
+struct CrcImplementation
+{
+    CrcFunction update;
+    const char* name;
+};
+
+static CrcImplementation pickCrc()
+{
+#if defined(__aarch64__)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+    {
+        return {crc32Armv8, "armv8"};
+    }
+#elif defined(__ARM_FEATURE_CRC32)
+    return {crc32Armv8, "armv8"};
+#endif
+
+    return {crc32Slicing8, "slicing-by-8"};
+}
+
+static const CrcImplementation crcImplementation = pickCrc();
+
+uint32_t frameCrc(const char* data, size_t size)
+{
+    return ~crcImplementation.update(0xFFFFFFFF, (const uint8_t*)data, size);
+}
+
+const char* frameCrcImplementation()
+{
+    return crcImplementation.name;
+}
+
+} // namespace ikvm
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ikvm
+{
+/*
+ * @brief Computes the CRC-32 of frame data, the same checksum as
+ *        boost::crc_32_type, with the ARMv8 CRC32 instructions when the CPU
+ *        has them or slicing-by-8 tables otherwise
+ *
+ * @param[in] data - Frame data
+ * @param[in] size - Number of bytes of frame data
+ *
+ * @return CRC-32 of the data
+ */
+uint32_t frameCrc(const char* data, size_t size);
+
+/*
+ * @brief Names the CRC-32 implementation picked for this CPU
+ *
+ * @return "armv8" or "slicing-by-8"
+ */
+const char* frameCrcImplementation();
+
+} // namespace ikvm
@@ -0,0 +1,107 @@
+#include "ikvm_flight_recorder.hpp"
+
+#include <unistd.h>
+
+#include <phosphor-logging/log.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+namespace ikvm
+{
+
+using namespace phosphor::logging;
+
+FlightRecorder::FlightRecorder(std::chrono::seconds w, size_t b) :
+    window(w), maxBytes(b), bytes(0)
+{}
+
+void FlightRecorder::append(const FrameLogRecord& record, const char* data)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Entry kept;
+
+    if (record.payload > maxBytes)
+    {
+        return;
+    }
+
+    // Frames arrive at the capture rate, so recycling the storage of the
+    // forgotten ones keeps this to a copy
+    kept.record = record;
+    kept.record.magic = frameRecordMagic;
+    kept.data.swap(spare);
+    kept.data.assign(data, data + record.payload);
+    ring.push_back(std::move(kept));
+    bytes += record.payload;
+
+    while (ring.size() > 1)
+    {
+        uint64_t age = record.timestamp - ring.front().record.timestamp;
+
+        if (bytes <= maxBytes && age <= (uint64_t)window.count())
+        {
+            break;
+        }
+
+        bytes -= ring.front().data.size();
+        spare.swap(ring.front().data);
+        ring.pop_front();
+    }
+}
+
+bool FlightRecorder::save(const std::string& path)
+{
+    std::deque<Entry> frozen;
+    uint64_t offset;
+    int fd;
+    int idxFd;
+    size_t saved = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        frozen.swap(ring);
+        bytes = 0;
+    }
+
+    if (frozen.empty())
+    {
+        log<level::INFO>("No captured frames to save",
+                         entry("PATH=%s", path.c_str()));
+        return false;
+    }
+
+    if (!FrameLogWriter::create(path, fd, idxFd, offset))
+    {
+        return false;
+    }
+
+    for (const auto& frame : frozen)
+    {
+        if (!FrameLogWriter::writeRecord(fd, idxFd, offset, frame.record,
+                                         frame.data.data()))
+        {
+            log<level::ERR>("Failed to save captured frame",
+                            entry("PATH=%s", path.c_str()),
+                            entry("ERROR=%s", strerror(errno)));
+            break;
+        }
+        saved++;
+    }
+
+    close(idxFd);
+    close(fd);
+
+    log<level::INFO>(
+        "Saved captured frames", entry("PATH=%s", path.c_str()),
+        entry("FRAMES=%zu", saved),
+        entry("SPAN_MS=%llu",
+              (unsigned long long)((frozen.back().record.timestamp -
+                                    frozen.front().record.timestamp) /
+                                   1000000)));
+
+    return saved == frozen.size();
+}
+
+} // namespace ikvm
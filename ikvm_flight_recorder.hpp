@@ -0,0 +1,78 @@
+#pragma once
+
+#include "ikvm_frame_log.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ikvm
+{
+/*
+ * @class FlightRecorder
+ * @brief Keeps the most recent captured frames in memory, bounded in time
+ *        and bytes, so the frames leading up to an event can be saved as a
+ *        frame log after the fact
+ */
+class FlightRecorder
+{
+  public:
+    /*
+     * @brief Constructs FlightRecorder object
+     *
+     * @param[in] w - Capture time span of the kept frames
+     * @param[in] b - Most bytes of frame data kept
+     */
+    FlightRecorder(std::chrono::seconds w, size_t b);
+    ~FlightRecorder() = default;
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+    FlightRecorder(FlightRecorder&&) = delete;
+    FlightRecorder& operator=(FlightRecorder&&) = delete;
+
+    /*
+     * @brief Keeps a frame, forgetting the ones that fell out of the window
+     *
+     * @param[in] record - Metadata of the frame
+     * @param[in] data   - jpeg data of the frame, record.payload bytes
+     */
+    void append(const FrameLogRecord& record, const char* data);
+    /*
+     * @brief Freezes the kept frames and writes them out as a frame log;
+     *        recording goes on into an empty ring
+     *
+     * @param[in] path - Path to the frame log
+     *
+     * @return Boolean indicating if the frames were written
+     */
+    bool save(const std::string& path);
+
+  private:
+    /*
+     * @struct Entry
+     * @brief Stores a kept frame
+     */
+    struct Entry
+    {
+        FrameLogRecord record;
+        std::vector<char> data;
+    };
+
+    /* @brief Capture time span of the kept frames */
+    const std::chrono::nanoseconds window;
+    /* @brief Most bytes of frame data kept */
+    const size_t maxBytes;
+    /* @brief Mutex guarding the ring */
+    std::mutex lock;
+    /* @brief Kept frames, oldest first */
+    std::deque<Entry> ring;
+    /* @brief Bytes of frame data kept */
+    size_t bytes;
+    /* @brief Storage of the last forgotten frame, reused for the next one */
+    std::vector<char> spare;
+};
+
+} // namespace ikvm
@@ -0,0 +1,33 @@
+#include "ikvm_frame_governor.hpp"
+
+#include <algorithm>
+
+namespace ikvm
+{
+FrameGovernor::FrameGovernor() : idleFrames(0) {}
+
+void FrameGovernor::reset()
+{
+    idleFrames = 0;
+}
+
+int FrameGovernor::update(bool unchanged, int frameRate, int rate)
+{
+    if (!unchanged)
+    {
+        idleFrames = 0;
+        return frameRate;
+    }
+
+    if (++idleFrames < idleSeconds * std::max(rate, 1))
+    {
+        return rate;
+    }
+
+    // Step down gradually so a screen that changes every few seconds, like
+    // a clock, settles at a rate that still shows it promptly
+    idleFrames = 0;
+    return std::max(rate / 2, std::min(minRate, frameRate));
+}
+
+} // namespace ikvm
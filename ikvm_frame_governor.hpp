@@ -0,0 +1,47 @@
+#pragma once
+
+namespace ikvm
+{
+/*
+ * @class FrameGovernor
+ * @brief Lowers the capture frame rate while the screen doesn't change, so
+ *        idle sessions don't keep capturing and evaluating frames
+ */
+class FrameGovernor
+{
+  public:
+    FrameGovernor();
+    ~FrameGovernor() = default;
+    FrameGovernor(const FrameGovernor&) = default;
+    FrameGovernor& operator=(const FrameGovernor&) = default;
+    FrameGovernor(FrameGovernor&&) = default;
+    FrameGovernor& operator=(FrameGovernor&&) = default;
+
+    /*
+     * @brief Accounts a captured frame and picks the capture rate
+     *
+     * @param[in] unchanged - Whether the frame is the same as the last one
+     * @param[in] frameRate - Full frame rate of the video stream
+     * @param[in] rate      - Current capture frame rate
+     *
+     * @return Capture frame rate to use for the next frames
+     */
+    int update(bool unchanged, int frameRate, int rate);
+
+    /* @brief Forgets the unchanged frames counted so far */
+    void reset();
+
+  private:
+    /* @brief Seconds of unchanged frames before halving the capture rate */
+    static constexpr int idleSeconds = 2;
+    /*
+     * @brief Lowest capture rate; keeps a frame due well within the video
+     *        frame timeout
+     */
+    static constexpr int minRate = 2;
+
+    /* @brief Unchanged frames captured at the current rate */
+    int idleFrames;
+};
+
+} // namespace ikvm
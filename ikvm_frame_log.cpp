@@ -0,0 +1,262 @@
+#include "ikvm_frame_log.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <phosphor-logging/elog-errors.hpp>
+#include <phosphor-logging/elog.hpp>
+#include <phosphor-logging/log.hpp>
+#include <xyz/openbmc_project/Common/File/error.hpp>
+
+#include <cstring>
+
+namespace ikvm
+{
+
+using namespace phosphor::logging;
+using namespace sdbusplus::xyz::openbmc_project::Common::File::Error;
+
+static_assert(sizeof(FrameLogHeader) == 16, "frame log header layout");
+static_assert(sizeof(FrameLogRecord) == 48, "frame log record layout");
+
+/* @brief Alignment of the records in a frame log */
+static constexpr uint64_t recordAlign = 8;
+
+FrameLogWriter::FrameLogWriter(const std::string& p) :
+    path(p), fd(-1), idxFd(-1), offset(0), written(0), dropped(0),
+    queue([this](Entry& queued) { writeQueued(queued); }, maxQueued,
+          WorkQueue<Entry>::Drop::Newest, maxQueuedBytes)
+{
+    if (!create(path, fd, idxFd, offset))
+    {
+        elog<Open>(xyz::openbmc_project::Common::File::Open::ERRNO(errno),
+                   xyz::openbmc_project::Common::File::Open::PATH(
+                       path.c_str()));
+    }
+}
+
+FrameLogWriter::~FrameLogWriter()
+{
+    // Queued frames are still written on the way out
+    queue.stop();
+
+    close(idxFd);
+    close(fd);
+
+    log<level::INFO>("Closed frame log", entry("PATH=%s", path.c_str()),
+                     entry("FRAMES=%llu", (unsigned long long)written.load()),
+                     entry("DROPPED=%llu", (unsigned long long)dropped.load()));
+}
+
+bool FrameLogWriter::create(const std::string& path, int& fd, int& idxFd,
+                            uint64_t& offset)
+{
+    FrameLogHeader header = {frameLogMagic, frameLogVersion,
+                             sizeof(FrameLogRecord)};
+    std::string idxPath = path + ".idx";
+
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        log<level::ERR>("Failed to create frame log",
+                        entry("PATH=%s", path.c_str()),
+                        entry("ERROR=%s", strerror(errno)));
+        return false;
+    }
+
+    idxFd = open(idxPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                 0644);
+    if (idxFd < 0 || write(fd, &header, sizeof(header)) != sizeof(header))
+    {
+        log<level::ERR>("Failed to create frame log",
+                        entry("PATH=%s", idxFd < 0 ? idxPath.c_str()
+                                                   : path.c_str()),
+                        entry("ERROR=%s", strerror(errno)));
+        if (idxFd >= 0)
+        {
+            close(idxFd);
+        }
+        close(fd);
+        return false;
+    }
+
+    offset = sizeof(header);
+    return true;
+}
+
+bool FrameLogWriter::writeRecord(int fd, int idxFd, uint64_t& offset,
+                                 const FrameLogRecord& record,
+                                 const char* data)
+{
+    static const char padding[recordAlign] = {0};
+    size_t pad = (recordAlign - record.payload % recordAlign) % recordAlign;
+    size_t total = sizeof(record) + record.payload + pad;
+    iovec iov[3] = {{(void*)&record, sizeof(record)},
+                    {(void*)data, record.payload},
+                    {(void*)padding, pad}};
+
+    // Written at the end of the last complete record, so a partial write
+    // is overwritten by the next record
+    if (pwritev(fd, iov, 3, offset) != (ssize_t)total)
+    {
+        // Drop the partial record in case no other record follows
+        if (ftruncate(fd, offset) < 0)
+        {
+            log<level::ERR>("Failed to truncate frame log",
+                            entry("ERROR=%s", strerror(errno)));
+        }
+        return false;
+    }
+
+    // Without its index entry the record is still found by walking the log
+    uint64_t start = offset;
+    offset += total;
+
+    return write(idxFd, &start, sizeof(start)) == sizeof(start);
+}
+
+bool FrameLogWriter::append(const FrameLogRecord& record, const char* data)
+{
+    Entry queued;
+
+    // Only copied if it fits; only the capture thread appends, so the room
+    // checked here is still there
+    if (!queue.room(record.payload))
+    {
+        dropped++;
+        return false;
+    }
+
+    queued.record = record;
+    queued.record.magic = frameRecordMagic;
+    queued.data.assign(data, data + record.payload);
+
+    return queue.push(std::move(queued), record.payload);
+}
+
+void FrameLogWriter::writeQueued(Entry& queued)
+{
+    if (!writeRecord(fd, idxFd, offset, queued.record, queued.data.data()))
+    {
+        log<level::ERR>("Failed to append to frame log",
+                        entry("PATH=%s", path.c_str()),
+                        entry("ERROR=%s", strerror(errno)));
+        dropped++;
+        return;
+    }
+
+    written++;
+}
+
+FrameLogReader::FrameLogReader(const std::string& p) :
+    path(p), base(nullptr), length(0), recordSize(0)
+{
+    int fd;
+    struct stat st;
+    const FrameLogHeader* header;
+
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        log<level::ERR>("Failed to open frame log",
+                        entry("PATH=%s", path.c_str()),
+                        entry("ERROR=%s", strerror(errno)));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        elog<Open>(xyz::openbmc_project::Common::File::Open::ERRNO(errno),
+                   xyz::openbmc_project::Common::File::Open::PATH(
+                       path.c_str()));
+    }
+
+    length = st.st_size;
+    if (length >= sizeof(FrameLogHeader))
+    {
+        void* map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (map != MAP_FAILED)
+        {
+            base = (const char*)map;
+        }
+    }
+    close(fd);
+
+    header = (const FrameLogHeader*)base;
+    if (!header || header->magic != frameLogMagic ||
+        header->version != frameLogVersion ||
+        header->recordSize < sizeof(FrameLogRecord))
+    {
+        log<level::ERR>("Not a frame log", entry("PATH=%s", path.c_str()));
+        if (base)
+        {
+            munmap((void*)base, length);
+        }
+        elog<Read>(xyz::openbmc_project::Common::File::Read::ERRNO(EINVAL),
+                   xyz::openbmc_project::Common::File::Read::PATH(
+                       path.c_str()));
+    }
+
+    recordSize = header->recordSize;
+    loadIndex();
+}
+
+FrameLogReader::~FrameLogReader()
+{
+    munmap((void*)base, length);
+}
+
+uint64_t FrameLogReader::validate(uint64_t offset) const
+{
+    const FrameLogRecord* record;
+    uint64_t next;
+
+    if (offset < sizeof(FrameLogHeader) || offset % recordAlign ||
+        offset + recordSize > length)
+    {
+        return 0;
+    }
+
+    record = (const FrameLogRecord*)(base + offset);
+    next = offset + recordSize + record->payload;
+    next = (next + recordAlign - 1) & ~(recordAlign - 1);
+    if (record->magic != frameRecordMagic || next > length)
+    {
+        return 0;
+    }
+
+    return next;
+}
+
+void FrameLogReader::loadIndex()
+{
+    std::string idxPath = path + ".idx";
+    int idxFd = open(idxPath.c_str(), O_RDONLY | O_CLOEXEC);
+    uint64_t offset;
+
+    if (idxFd >= 0)
+    {
+        while (read(idxFd, &offset, sizeof(offset)) == sizeof(offset) &&
+               validate(offset))
+        {
+            offsets.push_back(offset);
+        }
+        close(idxFd);
+    }
+
+    // The records are contiguous, so walk whatever the index doesn't cover:
+    // the whole log without an index, or records written after the last
+    // index entry made it to disk
+    offset = offsets.empty() ? sizeof(FrameLogHeader)
+                             : validate(offsets.back());
+    while (uint64_t next = validate(offset))
+    {
+        offsets.push_back(offset);
+        offset = next;
+    }
+}
+
+} // namespace ikvm
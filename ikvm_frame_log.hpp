@@ -0,0 +1,248 @@
+#pragma once
+
+#include "ikvm_worker.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ikvm
+{
+/*
+ * Frame log layout, all fields little-endian as written by the BMC:
+ *
+ *   FrameLogHeader
+ *   { FrameLogRecord, payload, zero padding to 8 bytes } ...
+ *
+ * The index is a sidecar file with the same name plus ".idx" holding the
+ * uint64_t file offset of every record, so a reader can seek to any frame
+ * without walking the log. Both files are append-only; a record is only
+ * added to the index once it is completely written, so a log cut short by
+ * a crash is still readable up to its last indexed frame.
+ */
+
+/* @brief Magic number at the start of a frame log, "IKVMFLOG" */
+constexpr uint64_t frameLogMagic = 0x474f4c464d564b49ULL;
+/* @brief Magic number at the start of a frame log record, "FREC" */
+constexpr uint32_t frameRecordMagic = 0x43455246;
+/* @brief Version of the frame log layout */
+constexpr uint32_t frameLogVersion = 1;
+
+/*
+ * @struct FrameLogHeader
+ * @brief Header at the start of a frame log
+ */
+struct FrameLogHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    /* @brief Size of a FrameLogRecord, for readers of later versions */
+    uint32_t recordSize;
+};
+
+/*
+ * @struct FrameLogRecord
+ * @brief Metadata in front of every frame in a frame log
+ */
+struct FrameLogRecord
+{
+    uint32_t magic;
+    /* @brief Number of bytes of jpeg data following the record */
+    uint32_t payload;
+    /* @brief Driver sequence number of the frame */
+    uint32_t sequence;
+    /* @brief jpeg format, 0:standard jpeg, 2:partial jpeg; frames of the
+     *        other formats are not logged */
+    uint8_t format;
+    /* @brief jpeg subsampling, 1:420/0:444 */
+    uint8_t subsampling;
+    uint16_t reserved;
+    /* @brief Capture time in nanoseconds of the monotonic clock */
+    uint64_t timestamp;
+    /* @brief Width in pixels of the screen */
+    uint32_t width;
+    /* @brief Height in pixels of the screen */
+    uint32_t height;
+    /* @brief Bounding-box of a partial-jpeg frame */
+    int32_t left;
+    int32_t top;
+    uint32_t boxWidth;
+    uint32_t boxHeight;
+};
+
+/*
+ * @class FrameLogWriter
+ * @brief Appends frames to a frame log from a background thread. Appending
+ *        never blocks the caller: frames that don't fit in the bounded queue
+ *        are dropped and counted.
+ */
+class FrameLogWriter
+{
+  public:
+    /*
+     * @brief Constructs FrameLogWriter object and creates the log
+     *
+     * @param[in] p - Path to the frame log
+     */
+    explicit FrameLogWriter(const std::string& p);
+    ~FrameLogWriter();
+    FrameLogWriter(const FrameLogWriter&) = delete;
+    FrameLogWriter& operator=(const FrameLogWriter&) = delete;
+    FrameLogWriter(FrameLogWriter&&) = delete;
+    FrameLogWriter& operator=(FrameLogWriter&&) = delete;
+
+    /*
+     * @brief Queues a frame to be appended to the log
+     *
+     * @param[in] record - Metadata of the frame
+     * @param[in] data   - jpeg data of the frame, record.payload bytes
+     *
+     * @return Boolean indicating if the frame was queued, false if dropped
+     */
+    bool append(const FrameLogRecord& record, const char* data);
+
+    /*
+     * @brief Writes a frame to a log synchronously
+     *
+     * @param[in]     fd     - File descriptor of the frame log
+     * @param[in]     idxFd  - File descriptor of the index
+     * @param[in,out] offset - Offset of the end of the log
+     * @param[in]     record - Metadata of the frame
+     * @param[in]     data   - jpeg data of the frame, record.payload bytes
+     *
+     * @return Boolean indicating if the frame was written
+     */
+    static bool writeRecord(int fd, int idxFd, uint64_t& offset,
+                            const FrameLogRecord& record, const char* data);
+    /*
+     * @brief Creates a frame log and its index and writes the header
+     *
+     * @param[in]  path   - Path to the frame log
+     * @param[out] fd     - File descriptor of the frame log
+     * @param[out] idxFd  - File descriptor of the index
+     * @param[out] offset - Offset of the end of the log
+     *
+     * @return Boolean indicating if the log was created
+     */
+    static bool create(const std::string& path, int& fd, int& idxFd,
+                       uint64_t& offset);
+
+  private:
+    /* @brief Largest number of frames waiting to be written */
+    static constexpr size_t maxQueued = 64;
+    /* @brief Largest number of bytes of frame data waiting to be written */
+    static constexpr size_t maxQueuedBytes = 8 * 1024 * 1024;
+
+    /*
+     * @struct Entry
+     * @brief Stores a queued frame
+     */
+    struct Entry
+    {
+        FrameLogRecord record;
+        std::vector<char> data;
+    };
+
+    /*
+     * @brief Writes a queued frame, on the worker thread
+     *
+     * @param[in] queued - Frame to write
+     */
+    void writeQueued(Entry& queued);
+
+    /* @brief Path to the frame log */
+    const std::string path;
+    /* @brief File descriptor of the frame log */
+    int fd;
+    /* @brief File descriptor of the index */
+    int idxFd;
+    /* @brief Offset of the end of the log */
+    uint64_t offset;
+    /* @brief Frames appended to the log */
+    std::atomic<uint64_t> written;
+    /* @brief Frames dropped because the queue was full or writing failed */
+    std::atomic<uint64_t> dropped;
+    /* @brief Writes the queued frames; new frames are dropped while it is
+     *        full */
+    WorkQueue<Entry> queue;
+};
+
+/*
+ * @class FrameLogReader
+ * @brief Maps a frame log to iterate its frames without copying them
+ */
+class FrameLogReader
+{
+  public:
+    /*
+     * @brief Constructs FrameLogReader object and maps the log
+     *
+     * @param[in] p - Path to the frame log
+     */
+    explicit FrameLogReader(const std::string& p);
+    ~FrameLogReader();
+    FrameLogReader(const FrameLogReader&) = delete;
+    FrameLogReader& operator=(const FrameLogReader&) = delete;
+    FrameLogReader(FrameLogReader&&) = delete;
+    FrameLogReader& operator=(FrameLogReader&&) = delete;
+
+    /*
+     * @brief Gets the number of complete frames in the log
+     *
+     * @return Number of frames
+     */
+    inline size_t size() const
+    {
+        return offsets.size();
+    }
+    /*
+     * @brief Gets a frame of the log
+     *
+     * @param[in] i - Index of the frame
+     *
+     * @return Pointer to the metadata of the frame, the jpeg data directly
+     *         follows it
+     */
+    inline const FrameLogRecord* record(size_t i) const
+    {
+        return (const FrameLogRecord*)(base + offsets[i]);
+    }
+    /*
+     * @brief Gets the jpeg data of a frame
+     *
+     * @param[in] i - Index of the frame
+     *
+     * @return Pointer to the jpeg data in the mapping
+     */
+    inline const char* data(size_t i) const
+    {
+        return base + offsets[i] + recordSize;
+    }
+
+  private:
+    /* @brief Reads the index, or rebuilds it by walking the log */
+    void loadIndex();
+    /*
+     * @brief Checks that a complete record lies at an offset of the log
+     *
+     * @param[in] offset - Offset of the record
+     *
+     * @return Offset of the next record, 0 if the record is not complete
+     */
+    uint64_t validate(uint64_t offset) const;
+
+    /* @brief Path to the frame log */
+    const std::string path;
+    /* @brief Start of the mapping of the log */
+    const char* base;
+    /* @brief Size in bytes of the log */
+    size_t length;
+    /* @brief Size of a record as stored in the log header */
+    uint32_t recordSize;
+    /* @brief Offsets of the complete frames */
+    std::vector<uint64_t> offsets;
+};
+
+} // namespace ikvm
@@ -0,0 +1,189 @@
+#include "ikvm_hextile.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ikvm
+{
+
+/* @brief RFB encoding number of hextile rectangles */
+static constexpr int32_t encodingHextile = 5;
+/* @brief Bytes of an RFB rectangle header */
+static constexpr size_t rectHeaderSize = 12;
+/* @brief Bytes per pixel of the engine's output */
+static constexpr size_t pixelSize = 2;
+
+/* @brief Hextile tile sub-encoding flags */
+static constexpr uint8_t hextileRaw = 1;
+static constexpr uint8_t hextileBackground = 2;
+static constexpr uint8_t hextileForeground = 4;
+static constexpr uint8_t hextileAnySubrects = 8;
+static constexpr uint8_t hextileSubrectsColoured = 16;
+
+static inline uint16_t readBE16(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint16_t readPixel(const uint8_t* p)
+{
+    uint16_t pixel;
+
+    memcpy(&pixel, p, pixelSize);
+    return pixel;
+}
+
+static void fill(uint16_t* fb, size_t stride, unsigned int x, unsigned int y,
+                 unsigned int w, unsigned int h, uint16_t pixel)
+{
+    for (unsigned int row = 0; row < h; row++)
+    {
+        uint16_t* line = fb + (y + row) * stride + x;
+
+        std::fill(line, line + w, pixel);
+    }
+}
+
+bool decodeHextile(const char* data, size_t size, unsigned int count,
+                   size_t width, size_t height, uint16_t* fb,
+                   std::vector<v4l2_rect>& rects)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + size;
+
+    rects.clear();
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        v4l2_rect rect;
+        uint16_t bg = 0;
+        uint16_t fg = 0;
+
+        if ((size_t)(end - p) < rectHeaderSize)
+        {
+            return false;
+        }
+
+        rect.left = readBE16(p);
+        rect.top = readBE16(p + 2);
+        rect.width = readBE16(p + 4);
+        rect.height = readBE16(p + 6);
+        if ((int32_t)((p[8] << 24) | (p[9] << 16) | (p[10] << 8) | p[11]) !=
+                encodingHextile ||
+            rect.left + rect.width > width || rect.top + rect.height > height)
+        {
+            return false;
+        }
+        p += rectHeaderSize;
+
+        for (unsigned int ty = 0; ty < rect.height; ty += 16)
+        {
+            for (unsigned int tx = 0; tx < rect.width; tx += 16)
+            {
+                unsigned int x = rect.left + tx;
+                unsigned int y = rect.top + ty;
+                unsigned int w = std::min(16u, rect.width - tx);
+                unsigned int h = std::min(16u, rect.height - ty);
+                uint8_t sub;
+
+                if (p >= end)
+                {
+                    return false;
+                }
+                sub = *p++;
+
+                if (sub & hextileRaw)
+                {
+                    if ((size_t)(end - p) < w * h * pixelSize)
+                    {
+                        return false;
+                    }
+
+                    for (unsigned int row = 0; fb && row < h; row++)
+                    {
+                        memcpy(fb + (y + row) * width + x,
+                               p + row * w * pixelSize, w * pixelSize);
+                    }
+                    p += w * h * pixelSize;
+                    continue;
+                }
+
+                if (sub & hextileBackground)
+                {
+                    if ((size_t)(end - p) < pixelSize)
+                    {
+                        return false;
+                    }
+                    bg = readPixel(p);
+                    p += pixelSize;
+                }
+                if (sub & hextileForeground)
+                {
+                    if ((size_t)(end - p) < pixelSize)
+                    {
+                        return false;
+                    }
+                    fg = readPixel(p);
+                    p += pixelSize;
+                }
+
+                if (fb)
+                {
+                    fill(fb, width, x, y, w, h, bg);
+                }
+
+                if (!(sub & hextileAnySubrects))
+                {
+                    continue;
+                }
+
+                if (p >= end)
+                {
+                    return false;
+                }
+
+                unsigned int subrects = *p++;
+                size_t subrectSize =
+                    (sub & hextileSubrectsColoured) ? pixelSize + 2 : 2;
+
+                if ((size_t)(end - p) < subrects * subrectSize)
+                {
+                    return false;
+                }
+
+                for (unsigned int s = 0; s < subrects; s++)
+                {
+                    uint16_t pixel = fg;
+
+                    if (sub & hextileSubrectsColoured)
+                    {
+                        pixel = readPixel(p);
+                        p += pixelSize;
+                    }
+
+                    unsigned int sx = p[0] >> 4;
+                    unsigned int sy = p[0] & 0xf;
+                    unsigned int sw = (p[1] >> 4) + 1;
+                    unsigned int sh = (p[1] & 0xf) + 1;
+                    p += 2;
+
+                    if (sx + sw > w || sy + sh > h)
+                    {
+                        return false;
+                    }
+
+                    if (fb)
+                    {
+                        fill(fb, width, x + sx, y + sy, sw, sh, pixel);
+                    }
+                }
+            }
+        }
+
+        rects.push_back(rect);
+    }
+
+    return true;
+}
+
+} // namespace ikvm
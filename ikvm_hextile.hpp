@@ -0,0 +1,31 @@
+#pragma once
+
+#include <linux/videodev2.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ikvm
+{
+/*
+ * @brief Walks the hextile rectangles the NPCM video engine produces, each
+ *        an RFB rectangle header followed by 16x16 hextile tiles of 16-bit
+ *        pixels, and optionally draws them
+ *
+ * @param[in]  data   - Rectangles of the frame
+ * @param[in]  size   - Number of bytes of rectangles
+ * @param[in]  count  - Number of rectangles
+ * @param[in]  width  - Width in pixels of the screen
+ * @param[in]  height - Height in pixels of the screen
+ * @param[out] fb     - 16-bit framebuffer to draw into, nullptr to only
+ *                      check the rectangles
+ * @param[out] rects  - Screen area of every rectangle
+ *
+ * @return Boolean indicating if the rectangles fit the data and the screen
+ */
+bool decodeHextile(const char* data, size_t size, unsigned int count,
+                   size_t width, size_t height, uint16_t* fb,
+                   std::vector<v4l2_rect>& rects);
+
+} // namespace ikvm
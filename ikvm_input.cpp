@@ -8,12 +8,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <rfb/keysym.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include <phosphor-logging/elog-errors.hpp>
 #include <phosphor-logging/elog.hpp>
 #include <phosphor-logging/log.hpp>
+#include <xyz/openbmc_project/Common/Device/error.hpp>
 #include <xyz/openbmc_project/Common/File/error.hpp>
 
 namespace fs = std::filesystem;
@@ -22,15 +24,47 @@ namespace ikvm
 {
 using namespace phosphor::logging;
 using namespace sdbusplus::xyz::openbmc_project::Common::File::Error;
+using namespace sdbusplus::xyz::openbmc_project::Common::Device::Error;
 
 Input::Input(const std::string& kbdPath, const std::string& ptrPath,
-             const std::string& udc) :
-    keyboardFd(-1), pointerFd(-1), keyboardReport{0}, pointerReport{0},
-    keyboardPath(kbdPath), pointerPath(ptrPath), udcName(udc),
+             const std::string& udc, unsigned int head, bool replay) :
+    keyboardFd(-1), pointerFd(-1), activityFd(-1), keyboardReport{0},
+    pointerReport{0}, keyboardPath(kbdPath), pointerPath(ptrPath),
+    udcName(udc),
+    udcPath(head ? hidGadgetPath + std::to_string(head) + "/UDC"
+                 : hidUdcPath),
     keyboardLedState{INITIAL_LED_STATE}
 {
+    activityFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (activityFd < 0)
+    {
+        log<level::WARNING>("Failed to create input activity eventfd",
+                            entry("ERROR=%s", strerror(errno)));
+    }
+
     hidUdcStream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-    hidUdcStream.open(hidUdcPath, std::ios::out | std::ios::app);
+
+    try
+    {
+        hidUdcStream.open(udcPath, std::ios::out | std::ios::app);
+    }
+    catch (std::ofstream::failure& e)
+    {
+        log<level::ERR>("Failed to open HID gadget UDC",
+                        entry("PATH=%s", udcPath.c_str()),
+                        entry("ERROR=%s", e.what()));
+
+        // Without a HID gadget the daemon can still replay a recording,
+        // e.g. on a development machine; a BMC must not come up without
+        if (!replay)
+        {
+            elog<ReadFailure>(
+                xyz::openbmc_project::Common::Device::ReadFailure::
+                    CALLOUT_ERRNO(errno),
+                xyz::openbmc_project::Common::Device::ReadFailure::
+                    CALLOUT_DEVICE_PATH(udcPath.c_str()));
+        }
+    }
 }
 
 Input::~Input()
@@ -45,6 +79,11 @@ Input::~Input()
         close(pointerFd);
     }
 
+    if (activityFd >= 0)
+    {
+        close(activityFd);
+    }
+
     disconnect();
     hidUdcStream.close();
 }
@@ -169,6 +208,8 @@ void Input::keyEvent(rfbBool down, rfbKeySym key, rfbClientPtr cl)
     Input* input = cd->input;
     bool sendKeyboard = false;
 
+    input->notifyActivity();
+
     if (input->keyboardFd < 0)
     {
         return;
@@ -247,7 +288,9 @@ void Input::pointerEvent(int buttonMask, int x, int y, rfbClientPtr cl)
     cd->lastActivityTime = std::chrono::steady_clock::now();
     Input* input = cd->input;
     Server* server = (Server*)cl->screen->screenData;
-    const Video& video = server->getVideo();
+    const VideoSource& video = server->getVideo();
+
+    input->notifyActivity();
 
     if (input->pointerFd < 0)
     {
@@ -292,6 +335,20 @@ void Input::pointerEvent(int buttonMask, int x, int y, rfbClientPtr cl)
     input->writePointer(input->pointerReport);
 }
 
+void Input::notifyActivity()
+{
+    uint64_t count = 1;
+
+    // Wakes the video capture so it can restore the full frame rate before
+    // the host reacts to the event
+    if (activityFd >= 0 && write(activityFd, &count, sizeof(count)) < 0 &&
+        errno != EAGAIN)
+    {
+        log<level::ERR>("Failed to signal input activity",
+                        entry("ERROR=%s", strerror(errno)));
+    }
+}
+
 void Input::sendWakeupPacket()
 {
     uint8_t wakeupReport[KEY_REPORT_LENGTH] = {0};
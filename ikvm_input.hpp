@@ -46,9 +46,12 @@ class Input
      * @param[in] kbdPath - Path to the USB keyboard device
      * @param[in] ptrPath - Path to the USB mouse device
      * @param[in] udc - Name of UDC
+     * @param[in] head - Index of the device set, picks the HID gadget
+     * @param[in] replay - Video is replayed from a recording, so a missing
+     *                     HID gadget is tolerated
      */
     Input(const std::string& kbdPath, const std::string& ptrPath,
-          const std::string& udc);
+          const std::string& udc, unsigned int head = 0, bool replay = false);
     ~Input();
     Input(const Input&) = default;
     Input& operator=(const Input&) = default;
@@ -84,6 +87,16 @@ class Input
     /* @brief getter method for keyboardLedState (AMI Extension) */
     int getkeyboardLedState();
 
+    /*
+     * @brief Gets the eventfd signalled on every key or pointer event
+     *
+     * @return File descriptor of the eventfd, -1 if unavailable
+     */
+    inline int getActivityFd() const
+    {
+        return activityFd;
+    }
+
   private:
     static constexpr int NUM_MODIFIER_BITS = 4;
     static constexpr int KEY_REPORT_LENGTH = 8;
@@ -106,6 +119,9 @@ class Input
     /* @brief Path to the HID gadget UDC */
     static constexpr const char* hidUdcPath =
         "/sys/kernel/config/usb_gadget/obmc_hid/UDC";
+    /* @brief Prefix of the HID gadgets of the other device sets */
+    static constexpr const char* hidGadgetPath =
+        "/sys/kernel/config/usb_gadget/obmc_hid";
     /* @brief Path to the USB virtual hub */
     static constexpr const char* usbVirtualHubPath =
         "/sys/bus/platform/devices/1e6a0000.usb-vhub";
@@ -133,6 +149,9 @@ class Input
      */
     int readKeyBoardOutReport();
 
+    /* @brief Signals a key or pointer event on the activity eventfd */
+    void notifyActivity();
+
     bool writeKeyboard(const uint8_t* report);
     void writePointer(const uint8_t* report);
 
@@ -140,6 +159,8 @@ class Input
     int keyboardFd;
     /* @brief File descriptor for the USB mouse device */
     int pointerFd;
+    /* @brief Eventfd signalled on every key or pointer event */
+    int activityFd;
     /* @brief Data for keyboard report */
     uint8_t keyboardReport[KEY_REPORT_LENGTH];
     /* @brief Data for pointer report */
@@ -150,6 +171,8 @@ class Input
     std::string pointerPath;
     /* @brief Name of UDC */
     std::string udcName;
+    /* @brief Path to the HID gadget UDC of the device set */
+    std::string udcPath;
     /* @brief Holds the KeyboardLED state of Host (AMI Extension) */
     LEDData_t keyboardLedState;
     /*
@@ -0,0 +1,114 @@
+#include "ikvm_jpeg.hpp"
+
+#include <phosphor-logging/log.hpp>
+
+namespace ikvm
+{
+
+using namespace phosphor::logging;
+
+static void jpegErrorExit(j_common_ptr info)
+{
+    char message[JMSG_LENGTH_MAX];
+    JpegError* err = (JpegError*)info->err;
+
+    (*info->err->format_message)(info, message);
+    log<level::ERR>(err->what, entry("ERROR=%s", message));
+    longjmp(err->jump, 1);
+}
+
+jpeg_error_mgr* jpegErrorManager(JpegError& err, const char* what)
+{
+    jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = jpegErrorExit;
+    err.what = what;
+
+    return &err.mgr;
+}
+
+bool parseJpeg(const char* data, size_t size, JpegInfo& info)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    size_t i = 2;
+    bool frameHeader = false;
+
+    info = {};
+
+    if (size < 4 || p[0] != 0xFF || p[1] != 0xD8 || p[size - 2] != 0xFF ||
+        p[size - 1] != 0xD9)
+    {
+        return false;
+    }
+
+    info.eoiOffset = size - 2;
+
+    while (i + 4 <= info.eoiOffset)
+    {
+        if (p[i] != 0xFF)
+        {
+            return false;
+        }
+
+        uint8_t marker = p[i + 1];
+
+        // Any marker may be preceded by fill bytes
+        if (marker == 0xFF)
+        {
+            i++;
+            continue;
+        }
+
+        // TEM and RSTn stand alone, without a length
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+        {
+            i += 2;
+            continue;
+        }
+
+        // SOI or EOI ahead of the first scan
+        if (marker == 0xD8 || marker == 0xD9)
+        {
+            return false;
+        }
+
+        size_t length = (p[i + 2] << 8) | p[i + 3];
+
+        if (length < 2 || i + 2 + length > info.eoiOffset)
+        {
+            return false;
+        }
+
+        // SOF0 to SOF15, except DHT, JPG and DAC which share the range
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+            marker != 0xC8 && marker != 0xCC)
+        {
+            if (length < 8 || length < 8u + 3u * p[i + 9])
+            {
+                return false;
+            }
+
+            info.height = (p[i + 5] << 8) | p[i + 6];
+            info.width = (p[i + 7] << 8) | p[i + 8];
+            info.components = p[i + 9];
+            for (unsigned int c = 0;
+                 c < info.components && c < jpegMaxComponents; c++)
+            {
+                info.sampling[c] = p[i + 11 + 3 * c];
+            }
+            frameHeader = true;
+        }
+        else if (marker == 0xDA)
+        {
+            info.sosOffset = i;
+            info.scanOffset = i + 2 + length;
+            info.valid = frameHeader;
+            return info.valid;
+        }
+
+        i += 2 + length;
+    }
+
+    return false;
+}
+
+} // namespace ikvm
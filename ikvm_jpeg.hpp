@@ -0,0 +1,80 @@
+#pragma once
+
+#include <setjmp.h>
+#include <stdio.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <jpeglib.h>
+
+namespace ikvm
+{
+/* @brief Most components of a jpeg described */
+constexpr unsigned int jpegMaxComponents = 4;
+
+/*
+ * @struct JpegInfo
+ * @brief Describes the layout of a jpeg, filled once per captured frame
+ */
+struct JpegInfo
+{
+    /* @brief SOI, a frame header, a scan header and EOI are all in place */
+    bool valid;
+    /* @brief Offset of the start-of-scan marker */
+    uint32_t sosOffset;
+    /* @brief Offset of the entropy-coded data of the first scan */
+    uint32_t scanOffset;
+    /* @brief Offset of the end-of-image marker */
+    uint32_t eoiOffset;
+    /* @brief Width in pixels of the image */
+    uint16_t width;
+    /* @brief Height in pixels of the image */
+    uint16_t height;
+    /* @brief Number of components of the image */
+    uint8_t components;
+    /*
+     * @brief Sampling factors of each component, horizontal in the high
+     *        nibble and vertical in the low one
+     */
+    std::array<uint8_t, jpegMaxComponents> sampling;
+};
+
+/*
+ * @brief Walks the marker segments of a jpeg up to its first scan and
+ *        checks that it ends in an EOI marker. Only the headers are read;
+ *        the entropy-coded data is skipped over, not scanned.
+ *
+ * @param[in]  data - jpeg data
+ * @param[in]  size - Number of bytes of jpeg data
+ * @param[out] info - Layout of the jpeg
+ *
+ * @return Boolean indicating if the jpeg is complete
+ */
+bool parseJpeg(const char* data, size_t size, JpegInfo& info);
+
+/*
+ * @struct JpegError
+ * @brief libjpeg error manager returning to the caller instead of exiting
+ */
+struct JpegError
+{
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+    /* @brief Logged in front of the libjpeg message */
+    const char* what;
+};
+
+/*
+ * @brief Sets up a libjpeg error manager that logs an error and longjmps
+ *        to err.jump, which the caller has to setjmp() before using libjpeg
+ *
+ * @param[out] err  - Error manager
+ * @param[in]  what - Message to log errors with
+ *
+ * @return libjpeg error manager for the err field of the codec
+ */
+jpeg_error_mgr* jpegErrorManager(JpegError& err, const char* what);
+
+} // namespace ikvm
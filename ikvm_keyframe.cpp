@@ -0,0 +1,330 @@
+#include "ikvm_keyframe.hpp"
+
+#include <phosphor-logging/log.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace ikvm
+{
+
+using namespace phosphor::logging;
+
+KeyframeCache::KeyframeCache() :
+    generation(0), screenWidth(0), screenHeight(0),
+    covered(false), wanted(false), encodedValid(false), canvasGeneration(0),
+    width(0), height(0), valid(false)
+{}
+
+KeyframeCache::~KeyframeCache()
+{
+    worker.stop();
+}
+
+void KeyframeCache::reset(size_t w, size_t h)
+{
+    std::lock_guard<std::mutex> guard(worker.mutex());
+
+    restart();
+    screenWidth = w;
+    screenHeight = h;
+}
+
+void KeyframeCache::restart()
+{
+    generation++;
+    jobs.clear();
+    covered = false;
+    encodedValid = false;
+    encoded.clear();
+    since.clear();
+}
+
+void KeyframeCache::submit(const char* data, size_t payload,
+                           const v4l2_rect& box,
+                           const VideoSource::Region* regions,
+                           unsigned int count)
+{
+    auto update = std::make_shared<VideoSource::Update>();
+
+    if (regions)
+    {
+        size_t size = 0;
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            size += regions[i].size;
+        }
+
+        // Only the jpegs are kept, back to back
+        update->data.reserve(size);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            VideoSource::Region region = regions[i];
+
+            update->data.insert(update->data.end(), data + region.offset,
+                                data + region.offset + region.size);
+            region.offset = update->data.size() - region.size;
+            update->regions.push_back(region);
+        }
+    }
+    else
+    {
+        update->data.assign(data, data + payload);
+        update->regions.push_back({box, 0, (uint32_t)payload});
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(worker.mutex());
+
+        // A frame that is never composited leaves stale areas behind, so
+        // the composite restarts from the next full screen instead
+        if (jobs.size() >= maxJobs)
+        {
+            log<level::WARNING>("Keyframe compositing fell behind");
+            restart();
+        }
+
+        jobs.push_back({generation, screenWidth, screenHeight, update});
+
+        worker.start([this] { run(); });
+    }
+    worker.notify();
+}
+
+bool KeyframeCache::ready()
+{
+    std::lock_guard<std::mutex> guard(worker.mutex());
+
+    // Encoded ahead of the first get, which then has it at hand
+    if (covered && !encodedValid)
+    {
+        wanted = true;
+        worker.notify();
+    }
+
+    return covered;
+}
+
+bool KeyframeCache::get(std::vector<char>& jpeg,
+                        VideoSource::Updates& updates)
+{
+    std::lock_guard<std::mutex> guard(worker.mutex());
+
+    if (!encodedValid)
+    {
+        if (covered)
+        {
+            wanted = true;
+            worker.notify();
+        }
+        return false;
+    }
+
+    jpeg = encoded;
+    updates.assign(since.begin(), since.end());
+    for (const auto& job : jobs)
+    {
+        updates.push_back(job.update);
+    }
+
+    return true;
+}
+
+void KeyframeCache::run()
+{
+    std::unique_lock<std::mutex> ulock(worker.mutex());
+    std::vector<char> jpeg;
+
+    while (true)
+    {
+        // Queued frames are dropped on the way out
+        if (!worker.wait(ulock,
+                         [this] { return !jobs.empty() || encodeDue(); }))
+        {
+            return;
+        }
+
+        // A keyframe asked for goes ahead of the queued frames, which are
+        // handed out along with it
+        if (encodeDue())
+        {
+            uint64_t built = canvasGeneration;
+
+            ulock.unlock();
+            bool ok = encode(jpeg);
+            ulock.lock();
+
+            wanted = false;
+            if (ok && built == generation)
+            {
+                encoded.swap(jpeg);
+                encodedValid = true;
+                since.clear();
+            }
+            continue;
+        }
+
+        Job job = jobs.front();
+
+        ulock.unlock();
+
+        if (job.generation != canvasGeneration)
+        {
+            canvasGeneration = job.generation;
+            width = job.width;
+            height = job.height;
+            valid = false;
+        }
+
+        // Dropped while queued
+        if (job.generation == generation)
+        {
+            for (const auto& region : job.update->regions)
+            {
+                if (!decode(job.update->data.data() + region.offset, region))
+                {
+                    valid = false;
+                    break;
+                }
+            }
+        }
+
+        ulock.lock();
+
+        // Unless the queue was dropped meanwhile, the frame is now part of
+        // the composite instead of waiting for it
+        if (!jobs.empty() && jobs.front().update == job.update)
+        {
+            jobs.pop_front();
+
+            covered = valid;
+            if (encodedValid)
+            {
+                since.push_back(job.update);
+
+                // Too far behind to be worth sending; a new keyframe is
+                // encoded when one is asked for again
+                if (since.size() > maxJobs)
+                {
+                    encodedValid = false;
+                    encoded.clear();
+                    since.clear();
+                }
+            }
+        }
+    }
+}
+
+bool KeyframeCache::decode(const char* data,
+                           const VideoSource::Region& region)
+{
+    jpeg_decompress_struct dinfo;
+    JpegError err;
+    const v4l2_rect& r = region.box;
+    bool full = !r.left && !r.top && r.width >= width && r.height >= height;
+    size_t copyWidth;
+    size_t copyHeight;
+
+    // Nothing to add to until a frame covers the whole screen
+    if (!valid && !full)
+    {
+        return true;
+    }
+
+    if (r.left < 0 || r.top < 0 || (size_t)r.left >= width ||
+        (size_t)r.top >= height)
+    {
+        return false;
+    }
+
+    dinfo.err = jpegErrorManager(err, "Failed to composite keyframe");
+    jpeg_create_decompress(&dinfo);
+
+    if (setjmp(err.jump))
+    {
+        jpeg_destroy_decompress(&dinfo);
+        return false;
+    }
+
+    jpeg_mem_src(&dinfo, (const unsigned char*)data, region.size);
+    jpeg_read_header(&dinfo, TRUE);
+    dinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&dinfo);
+
+    if (canvas.size() != width * height * 3)
+    {
+        canvas.assign(width * height * 3, 0);
+    }
+
+    // The engine pads the jpeg to whole blocks past the region
+    copyWidth = std::min<size_t>({dinfo.output_width, r.width, width - r.left});
+    copyHeight =
+        std::min<size_t>({dinfo.output_height, r.height, height - r.top});
+    line.resize((size_t)dinfo.output_width * 3);
+
+    while (dinfo.output_scanline < dinfo.output_height)
+    {
+        size_t y = dinfo.output_scanline;
+        JSAMPROW row = line.data();
+
+        jpeg_read_scanlines(&dinfo, &row, 1);
+        if (y < copyHeight)
+        {
+            memcpy(&canvas[((r.top + y) * width + r.left) * 3], line.data(),
+                   copyWidth * 3);
+        }
+    }
+    jpeg_finish_decompress(&dinfo);
+    jpeg_destroy_decompress(&dinfo);
+
+    if (full)
+    {
+        valid = true;
+    }
+
+    return true;
+}
+
+bool KeyframeCache::encode(std::vector<char>& jpeg)
+{
+    jpeg_compress_struct cinfo;
+    JpegError err;
+    unsigned char* out = nullptr;
+    unsigned long outSize = 0;
+
+    cinfo.err = jpegErrorManager(err, "Failed to composite keyframe");
+    jpeg_create_compress(&cinfo);
+
+    if (setjmp(err.jump))
+    {
+        jpeg_destroy_compress(&cinfo);
+        free(out);
+        return false;
+    }
+
+    jpeg_mem_dest(&cinfo, &out, &outSize);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = &canvas[(size_t)cinfo.next_scanline * width * 3];
+
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+
+    jpeg.assign((char*)out, (char*)out + outSize);
+
+    jpeg_destroy_compress(&cinfo);
+    free(out);
+
+    return true;
+}
+
+} // namespace ikvm
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "ikvm_video_source.hpp"
+#include "ikvm_worker.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace ikvm
+{
+/*
+ * @class KeyframeCache
+ * @brief Composites the partial-jpeg frames into a full screen image in the
+ *        background, encoding a full jpeg of it only when one is asked for.
+ *        Callers never wait for the worker; they get the last jpeg along
+ *        with the frames captured since.
+ */
+class KeyframeCache
+{
+  public:
+    KeyframeCache();
+    ~KeyframeCache();
+    KeyframeCache(const KeyframeCache&) = delete;
+    KeyframeCache& operator=(const KeyframeCache&) = delete;
+    KeyframeCache(KeyframeCache&&) = delete;
+    KeyframeCache& operator=(KeyframeCache&&) = delete;
+
+    /*
+     * @brief Drops the composite; a new one starts with the next frame
+     *        covering the whole screen
+     *
+     * @param[in] w - Width in pixels of the screen
+     * @param[in] h - Height in pixels of the screen
+     */
+    void reset(size_t w, size_t h);
+    /*
+     * @brief Queues the jpegs of a partial-jpeg frame for compositing
+     *
+     * @param[in] data    - Frame data
+     * @param[in] payload - Number of bytes of frame data
+     * @param[in] box     - Bounding-box of the frame
+     * @param[in] regions - Changed regions, nullptr for a single jpeg of the
+     *                      bounding-box
+     * @param[in] count   - Number of changed regions
+     */
+    void submit(const char* data, size_t payload, const v4l2_rect& box,
+                const VideoSource::Region* regions, unsigned int count);
+    /*
+     * @brief Gets whether the composite covers the whole screen, asking the
+     *        worker to encode it if that was not done yet
+     *
+     * @return Boolean indicating if a keyframe can be had
+     */
+    bool ready();
+    /*
+     * @brief Gets the last full jpeg of the screen without waiting for the
+     *        worker, along with the frames queued after it; asks the worker
+     *        for one if there is none
+     *
+     * @param[out] jpeg    - Full screen jpeg
+     * @param[out] updates - Frames that bring the jpeg up to date
+     *
+     * @return Boolean indicating if there is a keyframe
+     */
+    bool get(std::vector<char>& jpeg, VideoSource::Updates& updates);
+
+  private:
+    /*
+     * @struct Job
+     * @brief Frame waiting to be composited
+     */
+    struct Job
+    {
+        /* @brief Composite the job was queued for */
+        uint64_t generation;
+        /* @brief Width in pixels of the screen */
+        size_t width;
+        /* @brief Height in pixels of the screen */
+        size_t height;
+        /* @brief Jpegs of the frame */
+        std::shared_ptr<const VideoSource::Update> update;
+    };
+
+    /* @brief Composites the queued frames until destroyed */
+    void run();
+    /* @brief Drops the composite and everything queued for it */
+    void restart();
+    /*
+     * @brief Gets whether the worker has to encode the composite
+     *
+     * @return Boolean indicating if a keyframe is asked for and missing
+     */
+    inline bool encodeDue() const
+    {
+        return wanted && covered && !encodedValid;
+    }
+    /*
+     * @brief Decodes a jpeg into its area of the composite
+     *
+     * @param[in] data   - Jpeg data
+     * @param[in] region - Screen area and size of the jpeg
+     *
+     * @return Boolean indicating if the jpeg was decoded
+     */
+    bool decode(const char* data, const VideoSource::Region& region);
+    /*
+     * @brief Encodes the composite into a full screen jpeg
+     *
+     * @param[out] jpeg - Full screen jpeg
+     *
+     * @return Boolean indicating if the jpeg was encoded
+     */
+    bool encode(std::vector<char>& jpeg);
+
+    /* @brief Most frames queued before the composite is given up, and
+     *        most frames kept after a keyframe before it is dropped */
+    static constexpr size_t maxJobs = 8;
+    /* @brief jpeg quality of the keyframes */
+    static constexpr int quality = 85;
+
+    /* @brief Composites the queued frames; its mutex protects the queue and
+     *        the encoded keyframe */
+    Worker worker;
+    /* @brief Frames waiting to be composited, the front one while the
+     *        worker composites it */
+    std::deque<Job> jobs;
+    /* @brief Incremented whenever the composite is dropped */
+    std::atomic<uint64_t> generation;
+    /* @brief Width in pixels of the screen of queued frames */
+    size_t screenWidth;
+    /* @brief Height in pixels of the screen of queued frames */
+    size_t screenHeight;
+    /* @brief The composite of the current generation covers the screen */
+    bool covered;
+    /* @brief A keyframe was asked for while there was none */
+    bool wanted;
+    /* @brief The encoded keyframe belongs to the current generation */
+    bool encodedValid;
+    /* @brief Full screen jpeg of the composite */
+    std::vector<char> encoded;
+    /* @brief Frames composited after the keyframe was encoded */
+    std::deque<std::shared_ptr<const VideoSource::Update>> since;
+
+    /* @brief Generation the composite was built for */
+    uint64_t canvasGeneration;
+    /* @brief Full screen RGB24 composite, only touched by the worker */
+    std::vector<uint8_t> canvas;
+    /* @brief Scanline of the jpeg being decoded */
+    std::vector<uint8_t> line;
+    /* @brief Width in pixels of the composite */
+    size_t width;
+    /* @brief Height in pixels of the composite */
+    size_t height;
+    /* @brief The composite covers the whole screen */
+    bool valid;
+};
+
+} // namespace ikvm
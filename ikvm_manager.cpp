@@ -1,5 +1,7 @@
 #include "ikvm_manager.hpp"
 
+#include "ikvm_replay.hpp"
+
 #include <phosphor-logging/log.hpp>
 
 #include <thread>
@@ -12,21 +14,79 @@ namespace ikvm
 using namespace phosphor::logging;
 
 Manager::Manager(const Args& args) :
-    continueExecuting(true), serverDone(false), videoDone(true),
-    input(args.getKeyboardPath(), args.getPointerPath(), args.getUdcName()),
-    video(args.getVideoPath(), input, args.getFrameRate(),
-          args.getSubsampling(), args.getFormat()),
-    server(args, input, video), monitor()
+    continueExecuting(true), serverDone(false), videoDone(true), monitor()
+{
+    for (unsigned int i = 0; i < args.getHeadCount(); i++)
+    {
+        heads.push_back(std::make_unique<Head>(args, i));
+    }
+}
+
+Manager::Head::Head(const Args& args, unsigned int i) :
+    index(i),
+    input(args.getKeyboardPath(i), args.getPointerPath(i), args.getUdcName(i),
+          i, !args.getReplayPath().empty()),
+    video(createVideo(args, input, i)), server(args, input, *video, i)
 {}
 
+std::unique_ptr<VideoSource> Manager::createVideo(const Args& args,
+                                                  Input& input, unsigned int i)
+{
+    if (!args.getReplayPath().empty())
+    {
+        auto replay = std::make_unique<ReplaySource>(
+            args.getReplayPath(), args.getFrameRate(), args.getReplayRate());
+
+        replay->hashFrames(args.getCalcFrameCRC());
+        return replay;
+    }
+
+    auto video = std::make_unique<Video>(
+        args.getVideoPath(i), input, args.getFrameRate(),
+        args.getSubsampling(), args.getFormat(), args.getBufferCount(),
+        args.getAdaptiveBuffers(), args.getQuality(), args.getTargetBitrate(),
+        args.getAdaptiveFrameRate());
+
+    // A device set without frames must not hold up the others for long
+    if (args.getHeadCount() > 1)
+    {
+        video->setFrameWait(1000 /
+                            (args.getFrameRate() * (int)args.getHeadCount()));
+    }
+
+    if (!args.getRecordPath().empty())
+    {
+        video->record(i ? args.getRecordPath() + "." + std::to_string(i)
+                        : args.getRecordPath());
+    }
+
+    video->hashFrames(args.getCalcFrameCRC());
+
+    // Crash events are about the host of the first device set
+    if (!i)
+    {
+        video->keepFrames(std::chrono::seconds(args.getKeepSeconds()),
+                          (size_t)args.getKeepMegabytes() * 1024 * 1024);
+    }
+
+    return video;
+}
+
 void Manager::run()
 {
+    std::vector<std::thread> threads;
+
     createUtilities();
     auto conn = std::make_shared<sdbusplus::asio::connection>(io);
     conn->request_name(kvmServiceName.c_str());
     sdbusplus::asio::object_server objServer(conn);
 
-    Interface interface(objServer);
+    // The D-Bus object stands for the first device set only, on purpose:
+    // its path and interfaces are what existing clients look for. Capture
+    // tuning only applies to the V4L2 device, not to a replay.
+    Interface interface(io, objServer,
+                        dynamic_cast<Video*>(heads.front()->video.get()),
+                        screenshots, previews);
     interface.addInterfaces();
 
     sdbusplus::bus::match_t bsodMatcher = monitor.bsodErrorEventMonitor(conn);
@@ -35,19 +95,24 @@ void Manager::run()
     sdbusplus::bus::match_t captutreTimeout = monitor.sessionTimeout(conn);
     sdbusplus::bus::match_t powerStatMatcher = monitor.powerStatMonitor(conn);
 
-    std::thread run(serverThread, this);
-    std::thread runStatusUpdate(statusUpdateThread, this);
+    threads.emplace_back(serverThread, this);
+    threads.emplace_back(statusUpdateThread, this);
     io.run();
 
-    runStatusUpdate.join();
-    run.join();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
 }
 
 void Manager::serverThread(Manager* manager)
 {
     while (manager->continueExecuting)
     {
-        manager->server.run();
+        for (auto& head : manager->heads)
+        {
+            head->server.run();
+        }
         manager->setServerDone();
         manager->waitVideo();
     }
@@ -55,64 +120,152 @@ void Manager::serverThread(Manager* manager)
 
 void Manager::statusUpdateThread(Manager* manager)
 {
+    std::vector<Head*> resizing;
+
     while (manager->continueExecuting)
     {
-        if (manager->server.wantsFrame() || scrnshotFlag.load())
+        resizing.clear();
+        for (auto& head : manager->heads)
         {
-            manager->video.start();
+            captureHead(manager, head.get());
 
-            if (scrnshotFlag.load())
+            if (head->video->needsResize())
             {
-                if (manager->video.getFormat() == 2)
-                {
-                    manager->video.formatChange(0);
-                }
+                resizing.push_back(head.get());
             }
-            else if (manager->video.getFormat() !=
-                     manager->video.getOriginalFormat())
+        }
+
+        if (!resizing.empty())
+        {
+            manager->waitServer();
+            manager->videoDone = false;
+            for (Head* head : resizing)
             {
-                manager->video.formatChange(manager->video.getOriginalFormat());
+                head->video->resize();
+                head->server.resize();
             }
+            manager->setVideoDone();
+        }
+        else
+        {
+            manager->setVideoDone();
+            manager->waitServer();
+        }
+    }
+}
+
+void Manager::captureHead(Manager* manager, Head* head)
+{
+    VideoSource& video = *head->video;
+    Server& server = head->server;
+
+    // Screenshots are taken of the first device set
+    bool screenshot = !head->index && (scrnshotFlag.load() ||
+                                       manager->screenshots.pending());
+
+    // The frames from before a host crash are saved as they were kept,
+    // without capturing anything for it
+    if (!head->index && bsodFlag.exchange(false))
+    {
+        video.saveRecentFrames(bsodFrameLog);
+    }
+
+    // The preview of the first device set keeps the capture going
+    // without viewers
+    bool preview = !head->index && manager->previews.getEnabled();
+
+    // So do the frames kept for a host crash, though slowly, since on an
+    // unattended host nobody else would capture them
+    bool keep = !head->index && video.keepsFrames();
 
-            manager->video.getFrame();
+    if (server.wantsFrame() || screenshot || preview || keep)
+    {
+        video.start();
+        video.setUnattended(!server.wantsFrame() && !screenshot && !preview);
 
-            if (scrnshotFlag.load())
+        if (screenshot)
+        {
+            // Partial-jpeg frames are taken from their composite
+            if (video.getFormat() == 1 ||
+                (video.getFormat() == 2 && !video.hasKeyframe()))
             {
-                if (manager->video.getFormat() != 2)
-                {
-                    manager->video.screenShot(bsodAsJpeg);
-                    scrnshotFlag.store(false);
-                }
+                video.formatChange(0);
             }
+        }
+        else if (!server.wantsFrame())
+        {
+            // Previews are downscaled from plain jpeg frames, and only
+            // those are kept for a host crash
+            if (video.getFormat() == 1 || video.getFormat() == 2)
+            {
+                video.formatChange(0);
+            }
+        }
+        else
+        {
+            int format = video.getOriginalFormat();
 
-            if (manager->server.wantsFrame())
+            // Capture in the ASPEED format while every client takes it
+            if (server.wantsAspeedJpeg() && format != 3)
             {
-                manager->server.sendFrame();
+                format = 1;
             }
-            else
+
+            if (video.getFormat() != format)
             {
-                manager->video.releaseFrames();
+                video.formatChange(format);
             }
         }
-        else
+
+        video.getFrame();
+
+        if (preview)
         {
-            manager->video.stop();
+            manager->previews.submit(video);
         }
 
-        if (manager->video.needsResize())
+        if (screenshot)
         {
-            manager->waitServer();
-            manager->videoDone = false;
-            manager->video.resize();
-            manager->server.resize();
-            manager->setVideoDone();
+            if (video.getFormat() != 1 &&
+                (video.getFormat() != 2 || video.hasKeyframe()))
+            {
+                std::vector<char> image;
+
+                // The image is only copied here; storing it on flash is
+                // left to the writer so that viewers are not held up.
+                // A composite that is still being encoded, or a frame yet
+                // to be captured, is taken with one of the next frames.
+                if (video.screenShot(image))
+                {
+                    manager->screenshots.deliver(image);
+                    if (scrnshotFlag.exchange(false))
+                    {
+                        manager->screenshots.save(bsodAsJpeg, std::move(image));
+                    }
+                }
+                else if (video.getPixelformat() != V4L2_PIX_FMT_JPEG)
+                {
+                    // Hextile and RGB frames make no screenshot at all; the
+                    // one stored before is kept
+                    manager->screenshots.deliver(image);
+                    scrnshotFlag = false;
+                }
+            }
+        }
+
+        if (server.wantsFrame())
+        {
+            server.sendFrame();
         }
         else
         {
-            manager->setVideoDone();
-            manager->waitServer();
+            video.releaseFrames();
         }
     }
+    else
+    {
+        video.stop();
+    }
 }
 
 void Manager::setServerDone()
@@ -5,20 +5,27 @@
 #include "ami/include/ikvm_utils.hpp"
 #include "ikvm_args.hpp"
 #include "ikvm_input.hpp"
+#include "ikvm_preview.hpp"
+#include "ikvm_screenshot.hpp"
 #include "ikvm_server.hpp"
 #include "ikvm_video.hpp"
 
 #include <boost/asio.hpp>
 
 #include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace ikvm
 {
 /*
  * @class Manager
  * @brief Manages the VNC server by executing threaded loops of RFB operations
- *        and video device operations.
+ *        and video device operations. Every video/HID device set given on
+ *        the command line gets its own RFB server, while the two loops, the
+ *        D-Bus connection and monitors are shared. The D-Bus object,
+ *        screenshots, previews and crash frames are about the first set.
  */
 class Manager
 {
@@ -43,12 +50,34 @@ class Manager
 
   private:
     /*
-     * @brief Thread function to loop the RFB update operations
-     *
-     * @param[in] manager - Pointer to the Manager object
+     * @struct Head
+     * @brief Stores the input, video and RFB server of a device set
      */
-    static void serverThread(Manager* manager);
-    static void statusUpdateThread(Manager* manager);
+    struct Head
+    {
+        /*
+         * @brief Constructs Head object
+         *
+         * @param[in] args - Reference to Args object
+         * @param[in] i    - Index of the device set
+         */
+        Head(const Args& args, unsigned int i);
+        ~Head() = default;
+        Head(const Head&) = delete;
+        Head& operator=(const Head&) = delete;
+        Head(Head&&) = delete;
+        Head& operator=(Head&&) = delete;
+
+        /* @brief Index of the device set */
+        unsigned int index;
+        /* @brief Input object */
+        Input input;
+        /* @brief Video source */
+        std::unique_ptr<VideoSource> video;
+        /* @brief RFB server object */
+        Server server;
+    };
+
     /* @brief Notifies thread waiters that RFB operations are complete */
     void setServerDone();
     /* @brief Notifies thread waiters that video operations are complete */
@@ -58,6 +87,40 @@ class Manager
     /* @brief Blocks until video operations are complete */
     void waitVideo();
 
+    /*
+     * @brief Thread function to loop the RFB update operations of every
+     *        device set
+     *
+     * @param[in] manager - Pointer to the Manager object
+     */
+    static void serverThread(Manager* manager);
+    /*
+     * @brief Thread function to loop the video capture operations of every
+     *        device set
+     *
+     * @param[in] manager - Pointer to the Manager object
+     */
+    static void statusUpdateThread(Manager* manager);
+    /*
+     * @brief Captures a frame of a device set and sends it to its clients
+     *
+     * @param[in] manager - Pointer to the Manager object
+     * @param[in] head    - Pointer to the device set to capture from
+     */
+    static void captureHead(Manager* manager, Head* head);
+    /*
+     * @brief Creates the video source selected on the command line
+     *
+     * @param[in] args  - Reference to Args object
+     * @param[in] input - Reference to the Input object
+     * @param[in] i     - Index of the device set
+     *
+     * @return The V4L2 video device, or the replay of a recording
+     */
+    static std::unique_ptr<VideoSource> createVideo(const Args& args,
+                                                    Input& input,
+                                                    unsigned int i);
+
     /*
      * @brief Boolean to indicate whether the application should continue
      *        running
@@ -67,15 +130,14 @@ class Manager
     bool serverDone;
     /* @brief Boolean to indicate that video operations are complete */
     bool videoDone;
-    /* @brief Input object */
-    Input input;
-    /* @brief Video object */
-    Video video;
-    /* @brief RFB server object */
-    Server server;
+    /* @brief Device sets served by the daemon */
+    std::vector<std::unique_ptr<Head>> heads;
     /*@brief Monitor object*/
     Monitor monitor;
-
+    /* @brief Stores the screenshots off the capture thread */
+    ScreenshotWriter screenshots;
+    /* @brief Downscales the captured frames into previews */
+    PreviewGenerator previews;
     /* @brief Condition variable to enable waiting for thread completion */
     std::condition_variable sync;
     /* @brief Mutex for waiting on condition variable safely */
@@ -0,0 +1,168 @@
+#include "ikvm_preview.hpp"
+
+#include <phosphor-logging/log.hpp>
+
+#include <cstdlib>
+
+namespace ikvm
+{
+
+using namespace phosphor::logging;
+
+PreviewGenerator::PreviewGenerator() :
+    enabled(false), scale(4), width(0), height(0),
+    frames([this](std::vector<char>& input) { downscale(input, scale); }, 1,
+           WorkQueue<std::vector<char>>::Drop::Oldest)
+{}
+
+PreviewGenerator::~PreviewGenerator()
+{
+    frames.stop();
+}
+
+void PreviewGenerator::submit(const VideoSource& video)
+{
+    VideoSource::Frame current;
+    int format = video.getFormat();
+
+    if (!enabled || video.getPixelformat() != V4L2_PIX_FMT_JPEG ||
+        (format != 0 && format != 2) || !video.getCurrentFrame(current))
+    {
+        return;
+    }
+
+    // Partial-jpeg frames only make a preview when they cover the screen
+    if (!current.jpeg.valid || current.regions || current.box.left ||
+        current.box.top || current.box.width < video.getWidth() ||
+        current.box.height < video.getHeight() ||
+        current.timestamp - last < interval)
+    {
+        return;
+    }
+
+    frames.push(std::vector<char>(current.data,
+                                  current.data + current.jpeg.eoiOffset + 2));
+
+    last = current.timestamp;
+}
+
+bool PreviewGenerator::get(std::vector<char>& jpeg, uint32_t& w, uint32_t& h)
+{
+    std::lock_guard<std::mutex> guard(previewLock);
+
+    if (preview.empty())
+    {
+        return false;
+    }
+
+    jpeg = preview;
+    w = width;
+    h = height;
+
+    return true;
+}
+
+void PreviewGenerator::setEnabled(bool enable)
+{
+    enabled = enable;
+
+    if (!enable)
+    {
+        std::lock_guard<std::mutex> guard(previewLock);
+
+        preview.clear();
+    }
+}
+
+bool PreviewGenerator::setScale(uint32_t denom)
+{
+    if (denom != 2 && denom != 4 && denom != 8)
+    {
+        return false;
+    }
+
+    scale = denom;
+
+    return true;
+}
+
+bool PreviewGenerator::downscale(const std::vector<char>& input,
+                                 uint32_t denom)
+{
+    jpeg_decompress_struct dinfo;
+    jpeg_compress_struct cinfo;
+    JpegError err;
+    unsigned char* out = nullptr;
+    unsigned long outSize = 0;
+    size_t stride;
+
+    dinfo.err = jpegErrorManager(err, "Failed to make preview");
+    cinfo.err = dinfo.err;
+    jpeg_create_decompress(&dinfo);
+    jpeg_create_compress(&cinfo);
+
+    if (setjmp(err.jump))
+    {
+        jpeg_destroy_decompress(&dinfo);
+        jpeg_destroy_compress(&cinfo);
+        free(out);
+        return false;
+    }
+
+    jpeg_mem_src(&dinfo, (const unsigned char*)input.data(), input.size());
+    jpeg_read_header(&dinfo, TRUE);
+    dinfo.out_color_space = JCS_RGB;
+    // Only the low frequencies of each block are transformed back
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = denom;
+    dinfo.dct_method = JDCT_IFAST;
+    dinfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&dinfo);
+
+    stride = (size_t)dinfo.output_width * 3;
+    pixels.resize(stride * dinfo.output_height);
+    while (dinfo.output_scanline < dinfo.output_height)
+    {
+        JSAMPROW row = &pixels[dinfo.output_scanline * stride];
+
+        jpeg_read_scanlines(&dinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&dinfo);
+
+    jpeg_mem_dest(&cinfo, &out, &outSize);
+    cinfo.image_width = dinfo.output_width;
+    cinfo.image_height = dinfo.output_height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.dct_method = JDCT_IFAST;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = &pixels[cinfo.next_scanline * stride];
+
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+
+    {
+        std::lock_guard<std::mutex> guard(previewLock);
+
+        // Dropped while it was being made
+        if (enabled)
+        {
+            preview.assign((char*)out, (char*)out + outSize);
+            width = cinfo.image_width;
+            height = cinfo.image_height;
+        }
+    }
+
+    jpeg_destroy_decompress(&dinfo);
+    jpeg_destroy_compress(&cinfo);
+    free(out);
+
+    return true;
+}
+
+} // namespace ikvm
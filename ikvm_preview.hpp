@@ -0,0 +1,122 @@
+#pragma once
+
+#include "ikvm_video_source.hpp"
+#include "ikvm_worker.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace ikvm
+{
+/*
+ * @class PreviewGenerator
+ * @brief Keeps a downscaled jpeg of the screen, refreshed about once a
+ *        second from the captured frames. The scaling happens while
+ *        decoding, by libjpeg's reduced-size inverse DCT, so the full
+ *        resolution image is never produced.
+ */
+class PreviewGenerator
+{
+  public:
+    PreviewGenerator();
+    ~PreviewGenerator();
+    PreviewGenerator(const PreviewGenerator&) = delete;
+    PreviewGenerator& operator=(const PreviewGenerator&) = delete;
+    PreviewGenerator(PreviewGenerator&&) = delete;
+    PreviewGenerator& operator=(PreviewGenerator&&) = delete;
+
+    /*
+     * @brief Offers the current frame of a video source; only full screen
+     *        jpegs are taken, at most once per interval
+     *
+     * @param[in] video - Video source holding the current frame
+     */
+    void submit(const VideoSource& video);
+    /*
+     * @brief Gets the latest preview
+     *
+     * @param[out] jpeg - Downscaled jpeg of the screen
+     * @param[out] w    - Width in pixels of the preview
+     * @param[out] h    - Height in pixels of the preview
+     *
+     * @return Boolean indicating if there is a preview
+     */
+    bool get(std::vector<char>& jpeg, uint32_t& w, uint32_t& h);
+
+    /*
+     * @brief Gets whether previews are being made
+     *
+     * @return Boolean indicating if the capture has to feed previews
+     */
+    inline bool getEnabled() const
+    {
+        return enabled;
+    }
+    /*
+     * @brief Starts or stops making previews; stopping drops the latest
+     *
+     * @param[in] enable - Boolean indicating if previews are to be made
+     */
+    void setEnabled(bool enable);
+    /*
+     * @brief Gets the downscaling factor
+     *
+     * @return Denominator of the scale, 2, 4 or 8
+     */
+    inline uint32_t getScale() const
+    {
+        return scale;
+    }
+    /*
+     * @brief Sets the downscaling factor for the next previews
+     *
+     * @param[in] denom - Denominator of the scale, 2, 4 or 8
+     *
+     * @return Boolean indicating if the factor is supported
+     */
+    bool setScale(uint32_t denom);
+
+  private:
+    /*
+     * @brief Decodes a frame downscaled and encodes it again
+     *
+     * @param[in] input - jpeg of the frame
+     * @param[in] denom - Denominator of the scale
+     *
+     * @return Boolean indicating if a preview was made
+     */
+    bool downscale(const std::vector<char>& input, uint32_t denom);
+
+    /* @brief Time between two previews */
+    static constexpr std::chrono::milliseconds interval{1000};
+    /* @brief jpeg quality of the previews */
+    static constexpr int quality = 75;
+
+    /* @brief Previews are being made */
+    std::atomic<bool> enabled;
+    /* @brief Denominator of the scale of the next previews */
+    std::atomic<uint32_t> scale;
+    /* @brief Capture time of the last frame taken */
+    std::chrono::steady_clock::time_point last;
+
+    /* @brief Downscaled RGB24 image, worker only */
+    std::vector<uint8_t> pixels;
+
+    /* @brief Protects the latest preview */
+    std::mutex previewLock;
+    /* @brief Latest preview */
+    std::vector<char> preview;
+    /* @brief Width in pixels of the latest preview */
+    uint32_t width;
+    /* @brief Height in pixels of the latest preview */
+    uint32_t height;
+
+    /* @brief Downscales the offered frames; a frame the worker did not get
+     *        to yet is replaced by the next one */
+    WorkQueue<std::vector<char>> frames;
+};
+
+} // namespace ikvm
@@ -0,0 +1,67 @@
+#include "ikvm_rate_control.hpp"
+
+#include <algorithm>
+
+namespace ikvm
+{
+RateControl::RateControl(uint32_t kbps) : target(kbps), average(0), frames(0)
+{}
+
+void RateControl::setTarget(uint32_t kbps)
+{
+    target = kbps;
+}
+
+int RateControl::update(size_t payload, size_t backlog, int frameRate,
+                        int quality, int min, int max)
+{
+    size_t budget;
+    bool congested;
+    uint32_t kbps = target;
+
+    if (!kbps || min >= max)
+    {
+        return quality;
+    }
+
+    frameRate = std::max(frameRate, 1);
+
+    // Average over roughly a second of frames so a single large frame after
+    // a screen change doesn't drop the quality on its own
+    if (average)
+    {
+        average = (average * 7 + payload) / 8;
+    }
+    else
+    {
+        average = payload;
+    }
+
+    if (++frames < settleSeconds * frameRate)
+    {
+        return quality;
+    }
+
+    frames = 0;
+
+    // Per-frame byte budget if every frame at the full rate were sent; more
+    // than half a second of data still queued means the link is behind
+    budget = (size_t)kbps * 1000 / 8 / frameRate;
+    congested = backlog > budget * frameRate / 2;
+
+    if ((average > budget + budget / 8 || congested) && quality > min)
+    {
+        average = 0;
+        return quality - 1;
+    }
+
+    if (average < budget * 3 / 4 && !congested && quality < max)
+    {
+        average = 0;
+        return quality + 1;
+    }
+
+    return quality;
+}
+
+} // namespace ikvm
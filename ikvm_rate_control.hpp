@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ikvm
+{
+/*
+ * @class RateControl
+ * @brief Steers the hardware JPEG quality towards a target bitrate from the
+ *        measured frame sizes and the client send backlog
+ */
+class RateControl
+{
+  public:
+    /*
+     * @brief Constructs RateControl object
+     *
+     * @param[in] kbps - Target bitrate in kilobits per second, 0 to disable
+     */
+    explicit RateControl(uint32_t kbps = 0);
+    ~RateControl() = default;
+    RateControl(const RateControl&) = default;
+    RateControl& operator=(const RateControl&) = default;
+    RateControl(RateControl&&) = default;
+    RateControl& operator=(RateControl&&) = default;
+
+    /*
+     * @brief Gets the target bitrate
+     *
+     * @return Target bitrate in kilobits per second, 0 if disabled
+     */
+    inline uint32_t getTarget() const
+    {
+        return target;
+    }
+    /*
+     * @brief Sets the target bitrate
+     *
+     * @param[in] kbps - Target bitrate in kilobits per second, 0 to disable
+     */
+    void setTarget(uint32_t kbps);
+
+    /*
+     * @brief Accounts a sent frame and picks the quality for the next ones
+     *
+     * @param[in] payload   - Size in bytes of the sent frame
+     * @param[in] backlog   - Largest number of bytes still queued in a
+     *                        client socket
+     * @param[in] frameRate - Frame rate of the video stream
+     * @param[in] quality   - Current encoder quality
+     * @param[in] min       - Lowest encoder quality
+     * @param[in] max       - Highest encoder quality
+     *
+     * @return Encoder quality to use for the next frames
+     */
+    int update(size_t payload, size_t backlog, int frameRate, int quality,
+               int min, int max);
+
+  private:
+    /* @brief Seconds to let the encoder settle between quality steps */
+    static constexpr unsigned int settleSeconds = 1;
+
+    /* @brief Target bitrate in kilobits per second, 0 if disabled */
+    std::atomic<uint32_t> target;
+    /* @brief Moving average of the sent frame size in bytes */
+    size_t average;
+    /* @brief Frames sent since the last quality decision */
+    unsigned int frames;
+};
+
+} // namespace ikvm
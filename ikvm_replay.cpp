@@ -0,0 +1,317 @@
+#include "ikvm_replay.hpp"
+
+#include "ikvm_crc.hpp"
+
+#include <phosphor-logging/elog-errors.hpp>
+#include <phosphor-logging/elog.hpp>
+#include <phosphor-logging/log.hpp>
+#include <xyz/openbmc_project/Common/File/error.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace ikvm
+{
+
+using namespace phosphor::logging;
+using namespace sdbusplus::xyz::openbmc_project::Common::File::Error;
+
+ReplaySource::ReplaySource(const std::string& p, int fr, int rate) :
+    path(p), frameRate(fr), replayRate(rate), height(600), width(800),
+    format(0), loaded(false), resizeNeeded(false), pending(false),
+    running(false), hashing(false), next(0), sequence(0), current{}, sent(0),
+    sentBytes(0), skipped(0)
+{}
+
+void ReplaySource::load()
+{
+    if (fs::is_regular_file(path))
+    {
+        loadLog();
+    }
+    else
+    {
+        loadDirectory();
+    }
+
+    if (records.empty())
+    {
+        log<level::ERR>("Failed to find recorded frames",
+                        entry("PATH=%s", path.c_str()));
+        elog<Open>(
+            xyz::openbmc_project::Common::File::Open::ERRNO(ENOENT),
+            xyz::openbmc_project::Common::File::Open::PATH(path.c_str()));
+    }
+
+    log<level::INFO>("Loaded recorded frames", entry("PATH=%s", path.c_str()),
+                     entry("FRAMES=%zu", records.size()),
+                     entry("WIDTH=%zu", width), entry("HEIGHT=%zu", height),
+                     entry("FORMAT=%d", format));
+
+    loaded = true;
+}
+
+void ReplaySource::loadLog()
+{
+    size_t unsupported = 0;
+
+    frameLog = std::make_unique<FrameLogReader>(path);
+
+    for (size_t i = 0; i < frameLog->size(); i++)
+    {
+        const FrameLogRecord* record = frameLog->record(i);
+
+        // Only standard and partial jpeg frames are replayed
+        if (record->format != 0 && record->format != 2)
+        {
+            unsupported++;
+            continue;
+        }
+
+        // The screen of a recording keeps the resolution and format of its
+        // first frame
+        if (records.empty())
+        {
+            width = record->width;
+            height = record->height;
+            format = record->format;
+        }
+        else if (record->width != width || record->height != height ||
+                 record->format != format)
+        {
+            continue;
+        }
+
+        records.push_back({frameLog->data(i),
+                           record->payload,
+                           {record->left, record->top, record->boxWidth,
+                            record->boxHeight},
+                           {},
+                           -1});
+        parseJpeg(records.back().data, records.back().size,
+                  records.back().jpeg);
+    }
+
+    if (unsupported)
+    {
+        log<level::WARNING>("Skipping recorded frames of another format",
+                            entry("PATH=%s", path.c_str()),
+                            entry("FRAMES=%zu", unsupported));
+    }
+}
+
+void ReplaySource::loadDirectory()
+{
+    std::vector<fs::path> files;
+    std::ifstream boxes(fs::path(path) / "boxes");
+    std::error_code ec;
+
+    for (const auto& entry : fs::directory_iterator(path, ec))
+    {
+        auto ext = entry.path().extension();
+
+        if (entry.is_regular_file() && (ext == ".jpg" || ext == ".jpeg"))
+        {
+            files.push_back(entry.path());
+        }
+    }
+
+    if (ec)
+    {
+        log<level::ERR>("Failed to read recorded frames",
+                        entry("PATH=%s", path.c_str()),
+                        entry("ERROR=%s", ec.message().c_str()));
+        return;
+    }
+
+    std::sort(files.begin(), files.end());
+
+    if (boxes)
+    {
+        format = 2;
+        boxes >> width >> height;
+    }
+
+    for (const auto& file : files)
+    {
+        std::ifstream in(file, std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(in)),
+                               std::istreambuf_iterator<char>());
+        Record record{};
+
+        record.crc = -1;
+
+        if (data.size() < 2)
+        {
+            log<level::WARNING>("Skipping empty recorded frame",
+                                entry("FILE=%s", file.c_str()));
+            continue;
+        }
+
+        if (!parseJpeg(data.data(), data.size(), record.jpeg))
+        {
+            log<level::WARNING>("Recorded frame is not a complete jpeg",
+                                entry("FILE=%s", file.c_str()));
+        }
+        else if (format != 2 && records.empty())
+        {
+            width = record.jpeg.width;
+            height = record.jpeg.height;
+        }
+
+        record.box.left = 0;
+        record.box.top = 0;
+        record.box.width = width;
+        record.box.height = height;
+
+        if (format == 2)
+        {
+            boxes >> record.box.left >> record.box.top >> record.box.width >>
+                record.box.height;
+        }
+
+        storage.push_back(std::move(data));
+        record.data = storage.back().data();
+        record.size = storage.back().size();
+        records.push_back(record);
+    }
+}
+
+void ReplaySource::start()
+{
+    size_t oldHeight = height;
+    size_t oldWidth = width;
+
+    if (running)
+    {
+        return;
+    }
+
+    if (!loaded)
+    {
+        load();
+    }
+
+    if (oldHeight != height || oldWidth != width)
+    {
+        resizeNeeded = true;
+    }
+
+    running = true;
+    started = std::chrono::steady_clock::now();
+    deadline = started;
+    sent = 0;
+    sentBytes = 0;
+    skipped = 0;
+}
+
+void ReplaySource::stop()
+{
+    if (!running)
+    {
+        return;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+
+    log<level::INFO>("Replay stopped", entry("FRAMES=%llu", sent),
+                     entry("BYTES=%llu", sentBytes),
+                     entry("SKIPPED=%llu", skipped),
+                     entry("MILLISECONDS=%lld", (long long)elapsed));
+
+    running = false;
+    pending = false;
+}
+
+void ReplaySource::getFrame()
+{
+    if (!running || pending || records.empty())
+    {
+        return;
+    }
+
+    if (replayRate > 0)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        std::this_thread::sleep_until(deadline);
+
+        // Don't burst to catch up after the server fell behind
+        deadline = std::max(deadline, now) +
+                   std::chrono::microseconds(1000000 / replayRate);
+    }
+
+    Record& record = records[next];
+
+    // A recording repeats, so each frame is hashed only once
+    if (hashing && record.crc < 0)
+    {
+        size_t skip = record.jpeg.scanOffset;
+
+        record.crc = frameCrc(record.data + skip, record.size - skip);
+    }
+
+    current.index = next;
+    // Frames are only read from, so the mapping of a frame log is sent as is
+    current.data = const_cast<char*>(record.data);
+    current.payload = record.size;
+    current.sequence = sequence++;
+    current.box = record.box;
+    current.rects = 0;
+    current.regions = nullptr;
+    current.regionCount = 0;
+    current.jpeg = record.jpeg;
+    current.crc = hashing ? record.crc : -1;
+    current.timestamp = std::chrono::steady_clock::now();
+    pending = true;
+
+    next = (next + 1) % records.size();
+}
+
+void ReplaySource::releaseFrames()
+{
+    pending = false;
+}
+
+bool ReplaySource::getCurrentFrame(Frame& frame) const
+{
+    if (!pending)
+    {
+        return false;
+    }
+
+    frame = current;
+    return true;
+}
+
+void ReplaySource::frameSent(size_t)
+{
+    if (pending)
+    {
+        sent++;
+        sentBytes += current.payload;
+    }
+}
+
+bool ReplaySource::screenShot(std::vector<char>& image)
+{
+    if (!pending)
+    {
+        log<level::ERR>("No replayed frame to take");
+        image.clear();
+        return false;
+    }
+
+    image.assign(current.data, current.data + current.payload);
+
+    return true;
+}
+
+} // namespace ikvm
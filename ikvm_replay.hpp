@@ -0,0 +1,194 @@
+#pragma once
+
+#include "ikvm_frame_log.hpp"
+#include "ikvm_video_source.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ikvm
+{
+/*
+ * @class ReplaySource
+ * @brief Feeds recorded jpeg or partial-jpeg frames to the RFB server in
+ *        place of the video engine, so the send path can be exercised and
+ *        measured without the hardware.
+ *
+ *        The recording is either a frame log, replayed straight from its
+ *        mapping, or a directory of jpeg files replayed in name order. An
+ *        optional "boxes" file marks a partial-jpeg directory: its first
+ *        line holds the screen width and height and every following line
+ *        the left, top, width and height of the bounding-box of the frame
+ *        with the same position. Recordings are replayed in a loop.
+ */
+class ReplaySource : public VideoSource
+{
+  public:
+    /*
+     * @brief Constructs ReplaySource object
+     *
+     * @param[in] p    - Path to the recording
+     * @param[in] fr   - Frame rate reported to the RFB server
+     * @param[in] rate - Frames per second to replay at, 0 for unthrottled
+     */
+    ReplaySource(const std::string& p, int fr = 30, int rate = 0);
+    ~ReplaySource() override = default;
+    ReplaySource(const ReplaySource&) = default;
+    ReplaySource& operator=(const ReplaySource&) = default;
+    ReplaySource(ReplaySource&&) = default;
+    ReplaySource& operator=(ReplaySource&&) = default;
+
+    void getFrame() override;
+    void releaseFrames() override;
+    bool getCurrentFrame(Frame& frame) const override;
+    void frameSent(size_t backlog) override;
+    inline void frameUnchanged() override
+    {
+        skipped++;
+    }
+    inline void frameTruncated() override
+    {
+        skipped++;
+    }
+    /* @brief Recorded frames always cover the whole screen */
+    inline void requestFullFrame() override {}
+    /* @brief Recorded frames aren't composited */
+    inline bool hasKeyframe() override
+    {
+        return false;
+    }
+    inline bool getKeyframe(std::vector<char>&, Updates&) override
+    {
+        return false;
+    }
+    /*
+     * @brief Gets whether or not the video frame needs to be resized
+     *
+     * @return Boolean indicating if the recording has another resolution
+     */
+    inline bool needsResize() override
+    {
+        return resizeNeeded;
+    }
+    inline void resize() override
+    {
+        resizeNeeded = false;
+    }
+    /* @brief Loads the recording on first use and starts replaying it */
+    void start() override;
+    /* @brief Stops replaying and logs the replay throughput */
+    void stop() override;
+    inline int getFrameRate() const override
+    {
+        return frameRate;
+    }
+    inline size_t getHeight() const override
+    {
+        return height;
+    }
+    inline size_t getWidth() const override
+    {
+        return width;
+    }
+    inline uint32_t getPixelformat() const override
+    {
+        return V4L2_PIX_FMT_JPEG;
+    }
+    inline int getFormat() const override
+    {
+        return format;
+    }
+    inline int getOriginalFormat() const override
+    {
+        return format;
+    }
+    /* @brief Recorded frames keep the format they were captured in */
+    inline void formatChange(int) override {}
+    bool screenShot(std::vector<char>& image) override;
+    /* @brief Replayed frames are on disk already */
+    inline void saveRecentFrames(const std::string&) override {}
+    inline bool keepsFrames() const override
+    {
+        return false;
+    }
+    inline void setUnattended(bool) override {}
+    inline void hashFrames(bool enable) override
+    {
+        hashing = enable;
+    }
+
+  private:
+    /*
+     * @struct Record
+     * @brief Stores a recorded frame
+     */
+    struct Record
+    {
+        /* @brief jpeg data of the frame */
+        const char* data;
+        /* @brief Number of bytes of jpeg data */
+        size_t size;
+        /* @brief Bounding-box of a partial-jpeg frame */
+        v4l2_rect box;
+        /* @brief Layout of the jpeg, parsed when loaded */
+        JpegInfo jpeg;
+        /* @brief CRC-32 of the frame, -1 until it is first replayed */
+        int64_t crc;
+    };
+
+    /* @brief Reads the frames and bounding-boxes of the recording */
+    void load();
+    /* @brief Maps a frame log recording */
+    void loadLog();
+    /* @brief Reads a directory of jpeg files */
+    void loadDirectory();
+
+    /* @brief Path to the recording */
+    const std::string path;
+    /* @brief Frame rate reported to the RFB server */
+    int frameRate;
+    /* @brief Frames per second to replay at, 0 for unthrottled */
+    int replayRate;
+    /* @brief Height in pixels of the recorded screen */
+    size_t height;
+    /* @brief Width in pixels of the recorded screen */
+    size_t width;
+    /* @brief jpeg format, 0:standard jpeg, 2:partial jpeg */
+    int format;
+    /* @brief Indicates whether the recording has been read */
+    bool loaded;
+    /* @brief Indicates whether the recording has another resolution */
+    bool resizeNeeded;
+    /* @brief Indicates whether the current frame hasn't been released */
+    bool pending;
+    /* @brief Indicates whether the replay is running */
+    bool running;
+    /* @brief Hashes every replayed frame */
+    bool hashing;
+    /* @brief Recorded frames */
+    std::vector<Record> records;
+    /* @brief Storage of the frames read from a directory */
+    std::vector<std::vector<char>> storage;
+    /* @brief Mapping of a frame log recording */
+    std::unique_ptr<FrameLogReader> frameLog;
+    /* @brief Index of the next frame to replay */
+    size_t next;
+    /* @brief Sequence number of the next frame */
+    uint32_t sequence;
+    /* @brief Descriptor of the current frame */
+    Frame current;
+    /* @brief Time the next frame is due when throttled */
+    std::chrono::steady_clock::time_point deadline;
+    /* @brief Time the replay was started */
+    std::chrono::steady_clock::time_point started;
+    /* @brief Frames sent since the replay was started */
+    uint64_t sent;
+    /* @brief Bytes of frame data sent since the replay was started */
+    uint64_t sentBytes;
+    /* @brief Frames skipped since the replay was started */
+    uint64_t skipped;
+};
+
+} // namespace ikvm
@@ -0,0 +1,124 @@
+#include "ikvm_rgb.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace ikvm
+{
+
+void rgb24ToRgbx(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+    size_t i = 0;
+
+#if defined(__ARM_NEON)
+    uint8x16x4_t rgbx;
+
+    rgbx.val[3] = vdupq_n_u8(0);
+    for (; i + 16 <= pixels; i += 16)
+    {
+        uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+
+        rgbx.val[0] = rgb.val[0];
+        rgbx.val[1] = rgb.val[1];
+        rgbx.val[2] = rgb.val[2];
+        vst4q_u8(dst + i * 4, rgbx);
+    }
+#elif defined(__SSSE3__)
+    // Spreads four RGB24 pixels over 16 bytes, zeroing the fourth byte
+    const __m128i expand =
+        _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+    for (; i + 16 <= pixels; i += 16)
+    {
+        const __m128i* in = (const __m128i*)(src + i * 3);
+        __m128i* out = (__m128i*)(dst + i * 4);
+        __m128i a = _mm_loadu_si128(in);
+        __m128i b = _mm_loadu_si128(in + 1);
+        __m128i c = _mm_loadu_si128(in + 2);
+
+        _mm_storeu_si128(out, _mm_shuffle_epi8(a, expand));
+        _mm_storeu_si128(out + 1,
+                         _mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), expand));
+        _mm_storeu_si128(out + 2,
+                         _mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), expand));
+        _mm_storeu_si128(out + 3,
+                         _mm_shuffle_epi8(_mm_srli_si128(c, 4), expand));
+    }
+#endif
+
+    for (; i < pixels; i++)
+    {
+        dst[i * 4] = src[i * 3];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = 0;
+    }
+}
+
+void updateRgbTiles(const uint8_t* src, uint8_t* fb, size_t width,
+                    size_t height, std::vector<v4l2_rect>& dirty)
+{
+    uint8_t line[rgbTileSize * 4];
+
+    dirty.clear();
+
+    for (size_t ty = 0; ty < height; ty += rgbTileSize)
+    {
+        size_t th = std::min<size_t>(rgbTileSize, height - ty);
+        size_t runStart = 0;
+        bool inRun = false;
+
+        for (size_t tx = 0; tx < width; tx += rgbTileSize)
+        {
+            size_t tw = std::min<size_t>(rgbTileSize, width - tx);
+            bool changed = false;
+
+            for (size_t y = ty; y < ty + th; y++)
+            {
+                const uint8_t* s = src + (y * width + tx) * 3;
+                uint8_t* d = fb + (y * width + tx) * 4;
+
+                // Once a line of the tile differs, the rest is written
+                // without comparing
+                if (changed)
+                {
+                    rgb24ToRgbx(s, d, tw);
+                    continue;
+                }
+
+                rgb24ToRgbx(s, line, tw);
+                if (memcmp(line, d, tw * 4))
+                {
+                    memcpy(d, line, tw * 4);
+                    changed = true;
+                }
+            }
+
+            if (changed && !inRun)
+            {
+                runStart = tx;
+                inRun = true;
+            }
+            else if (!changed && inRun)
+            {
+                dirty.push_back({(int32_t)runStart, (int32_t)ty,
+                                 (uint32_t)(tx - runStart), (uint32_t)th});
+                inRun = false;
+            }
+        }
+
+        if (inRun)
+        {
+            dirty.push_back({(int32_t)runStart, (int32_t)ty,
+                             (uint32_t)(width - runStart), (uint32_t)th});
+        }
+    }
+}
+
+} // namespace ikvm
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <linux/videodev2.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ikvm
+{
+/* @brief Width and height in pixels of the tiles compared between frames */
+constexpr unsigned int rgbTileSize = 32;
+
+/*
+ * @brief Expands packed RGB24 pixels to the 32bpp RGBX layout of the RFB
+ *        framebuffer, with NEON or SSSE3 where the target has them
+ *
+ * @param[in]  src    - RGB24 pixels
+ * @param[out] dst    - RGBX pixels
+ * @param[in]  pixels - Number of pixels
+ */
+void rgb24ToRgbx(const uint8_t* src, uint8_t* dst, size_t pixels);
+
+/*
+ * @brief Converts an RGB24 frame into the 32bpp framebuffer holding the
+ *        previous one, writing and reporting only the tiles that changed
+ *
+ * @param[in]     src    - RGB24 frame, width * 3 bytes per line
+ * @param[in,out] fb     - RGBX framebuffer, width * 4 bytes per line
+ * @param[in]     width  - Width in pixels of the frame
+ * @param[in]     height - Height in pixels of the frame
+ * @param[out]    dirty  - Runs of changed tiles, one rectangle per run
+ */
+void updateRgbTiles(const uint8_t* src, uint8_t* fb, size_t width,
+                    size_t height, std::vector<v4l2_rect>& dirty);
+
+} // namespace ikvm
@@ -0,0 +1,125 @@
+#include "ikvm_screenshot.hpp"
+
+#include <phosphor-logging/log.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace ikvm
+{
+
+using namespace phosphor::logging;
+
+ScreenshotWriter::ScreenshotWriter() :
+    lastTicket(0), jobs(write, maxJobs, WorkQueue<Job>::Drop::Oldest)
+{}
+
+ScreenshotWriter::~ScreenshotWriter()
+{
+    // Queued images are still written on the way out
+    jobs.stop();
+}
+
+void ScreenshotWriter::save(const std::string& path, std::vector<char>&& image)
+{
+    // Never replace a stored screenshot with nothing
+    if (image.empty())
+    {
+        return;
+    }
+
+    if (!jobs.push({path, std::move(image)}))
+    {
+        log<level::WARNING>("Dropping unwritten screenshot",
+                            entry("FILE_PATH=%s", path.c_str()));
+    }
+}
+
+uint64_t ScreenshotWriter::request(Callback&& done)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (waiters.size() >= maxWaiters)
+    {
+        return 0;
+    }
+
+    waiters.emplace_back(++lastTicket, std::move(done));
+
+    return lastTicket;
+}
+
+bool ScreenshotWriter::cancel(uint64_t ticket)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = std::find_if(
+        waiters.begin(), waiters.end(),
+        [ticket](const auto& waiter) { return waiter.first == ticket; });
+
+    if (it == waiters.end())
+    {
+        return false;
+    }
+
+    waiters.erase(it);
+
+    return true;
+}
+
+bool ScreenshotWriter::pending()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    return !waiters.empty();
+}
+
+void ScreenshotWriter::deliver(const std::vector<char>& image)
+{
+    std::vector<std::pair<uint64_t, Callback>> served;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        served.swap(waiters);
+    }
+
+    for (auto& waiter : served)
+    {
+        waiter.second(image);
+    }
+}
+
+void ScreenshotWriter::write(const Job& job)
+{
+    std::string temp = job.path + ".tmp";
+    std::ofstream file(temp, std::ios::out | std::ios::binary);
+
+    if (!file)
+    {
+        log<level::ERR>("Failed to create destination file",
+                        entry("FILE_PATH=%s", temp.c_str()));
+        return;
+    }
+
+    file.write(job.image.data(), job.image.size());
+    file.close();
+
+    // Readers see either the previous screenshot or the whole new one
+    if (!file || std::rename(temp.c_str(), job.path.c_str()))
+    {
+        log<level::ERR>("Failed to store screenshot",
+                        entry("FILE_PATH=%s", job.path.c_str()),
+                        entry("ERROR=%s", strerror(errno)));
+        std::remove(temp.c_str());
+        return;
+    }
+
+    log<level::INFO>("Stored screenshot",
+                     entry("FILE_PATH=%s", job.path.c_str()),
+                     entry("BYTES=%zu", job.image.size()));
+}
+
+} // namespace ikvm
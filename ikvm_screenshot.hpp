@@ -0,0 +1,108 @@
+#pragma once
+
+#include "ikvm_worker.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ikvm
+{
+/*
+ * @class ScreenshotWriter
+ * @brief Stores screenshots on a worker thread so that the capture thread
+ *        only copies the image, and hands them to callers waiting for one
+ *        in memory
+ */
+class ScreenshotWriter
+{
+  public:
+    /* @brief Receives a screenshot on the capture thread */
+    using Callback = std::function<void(const std::vector<char>& image)>;
+
+    ScreenshotWriter();
+    ~ScreenshotWriter();
+    ScreenshotWriter(const ScreenshotWriter&) = delete;
+    ScreenshotWriter& operator=(const ScreenshotWriter&) = delete;
+    ScreenshotWriter(ScreenshotWriter&&) = delete;
+    ScreenshotWriter& operator=(ScreenshotWriter&&) = delete;
+
+    /*
+     * @brief Queues an image to be written to a file; the oldest queued
+     *        image is dropped if the worker fell behind
+     *
+     * @param[in] path  - Path to the file
+     * @param[in] image - Image data
+     */
+    void save(const std::string& path, std::vector<char>&& image);
+    /*
+     * @brief Asks for the next screenshot in memory
+     *
+     * @param[in] done - Called on the capture thread with the image, empty
+     *                   if none could be taken
+     *
+     * @return Ticket of the request, 0 if too many callers are waiting
+     *         already
+     */
+    uint64_t request(Callback&& done);
+    /*
+     * @brief Gives up on a request that was not served yet
+     *
+     * @param[in] ticket - Ticket of the request
+     *
+     * @return Boolean indicating if the request was still waiting; false
+     *         once its callback is running or has run
+     */
+    bool cancel(uint64_t ticket);
+    /*
+     * @brief Gets whether a caller waits for a screenshot in memory
+     *
+     * @return Boolean indicating if a screenshot is to be taken
+     */
+    bool pending();
+    /*
+     * @brief Hands a screenshot to every caller waiting for one
+     *
+     * @param[in] image - Image data, empty if none could be taken
+     */
+    void deliver(const std::vector<char>& image);
+
+  private:
+    /*
+     * @struct Job
+     * @brief Image waiting to be written
+     */
+    struct Job
+    {
+        std::string path;
+        std::vector<char> image;
+    };
+
+    /*
+     * @brief Replaces a file with an image
+     *
+     * @param[in] job - Path and data of the image
+     */
+    static void write(const Job& job);
+
+    /* @brief Most images queued for writing */
+    static constexpr size_t maxJobs = 2;
+    /* @brief Most callers waiting for a screenshot in memory */
+    static constexpr size_t maxWaiters = 8;
+
+    /* @brief Protects the waiting callers */
+    std::mutex lock;
+    /* @brief Callers waiting for a screenshot in memory */
+    std::vector<std::pair<uint64_t, Callback>> waiters;
+    /* @brief Ticket of the last request */
+    uint64_t lastTicket;
+    /* @brief Writes the queued images, the oldest dropped if it falls
+     *        behind */
+    WorkQueue<Job> jobs;
+};
+
+} // namespace ikvm
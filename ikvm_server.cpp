@@ -1,14 +1,22 @@
 #include "ikvm_server.hpp"
 
+#include "ikvm_crc.hpp"
+#include "ikvm_hextile.hpp"
+#include "ikvm_rgb.hpp"
+
+#include <linux/sockios.h>
 #include <linux/videodev2.h>
 #include <rfb/rfbproto.h>
+#include <sys/ioctl.h>
 
-#include <boost/crc.hpp>
 #include <phosphor-logging/elog-errors.hpp>
 #include <phosphor-logging/elog.hpp>
 #include <phosphor-logging/log.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
 
+#include <algorithm>
+#include <vector>
+
 #define ROUND_DOWN(x, r) ((x) & ~((r) - 1))
 
 #define DEFAULT_IP "~"        // Loopback IP address
@@ -25,16 +33,32 @@ namespace ikvm
 using namespace phosphor::logging;
 using namespace sdbusplus::xyz::openbmc_project::Common::Error;
 
-Server::Server(const Args& args, Input& i, Video& v) :
-    pendingResize(false), frameCounter(0), numClients(0), input(i), video(v)
+Server::Server(const Args& args, Input& i, VideoSource& v, unsigned int head) :
+    pendingResize(false), frameCounter(0), numClients(0), aspeedClients(0),
+    input(i), video(v)
 {
+    static int aspeedEncodings[] = {aspeedJpegEncoding, 0};
+    static rfbProtocolExtension aspeedExtension = {};
     std::string ip("localhost");
     const Args::CommandLine& commandLine = args.getCommandLine();
     int argc = commandLine.argc;
+    // libvncserver removes the options it parsed, so every device set
+    // parses its own copy of the command line
+    std::vector<char*> argv(commandLine.argv,
+                            commandLine.argv + commandLine.argc + 1);
+
+    // Extensions are global to libvncserver, so every device set shares
+    // the one registered first
+    if (!aspeedExtension.pseudoEncodings)
+    {
+        aspeedExtension.pseudoEncodings = aspeedEncodings;
+        aspeedExtension.enablePseudoEncoding = enableAspeedJpeg;
+        rfbRegisterProtocolExtension(&aspeedExtension);
+    }
 
-    server = rfbGetScreen(&argc, commandLine.argv, video.getWidth(),
-                          video.getHeight(), Video::bitsPerSample,
-                          Video::samplesPerPixel, Video::bytesPerPixel);
+    server = rfbGetScreen(&argc, argv.data(), video.getWidth(),
+                          video.getHeight(), bitsPerSample(),
+                          VideoSource::samplesPerPixel, bytesPerPixel());
 
     if (!server)
     {
@@ -44,8 +68,13 @@ Server::Server(const Args& args, Input& i, Video& v) :
             xyz::openbmc_project::Common::InvalidArgument::ARGUMENT_VALUE(""));
     }
 
-    framebuffer.resize(
-        video.getHeight() * video.getWidth() * Video::bytesPerPixel, 0);
+    framebuffer.resize(video.getHeight() * video.getWidth() * bytesPerPixel(),
+                       0);
+
+    if (video.getPixelformat() == V4L2_PIX_FMT_HEXTILE)
+    {
+        setHextileFormat();
+    }
 
     server->screenData = this;
     server->desktopName = "OneTree IKVM";
@@ -58,6 +87,14 @@ Server::Server(const Args& args, Input& i, Video& v) :
 
     rfbStringToAddr(&ip[0], &server->listenInterface);
 
+    if (head)
+    {
+        server->port += head;
+        server->ipv6port += head;
+        log<level::INFO>("Serving device set", entry("HEAD=%u", head),
+                         entry("PORT=%d", server->port));
+    }
+
     rfbInitServer(server);
 
     rfbMarkRectAsModified(server, 0, 0, video.getWidth(), video.getHeight());
@@ -65,9 +102,16 @@ Server::Server(const Args& args, Input& i, Video& v) :
     server->kbdAddEvent = Input::keyEvent;
     server->ptrAddEvent = Input::pointerEvent;
 
-    processTime = (1000000 / video.getFrameRate()) - 100;
+    // Every device set takes its turn in the same loop
+    processTime = ((1000000 / video.getFrameRate()) - 100) /
+                  (long int)args.getHeadCount();
 
     calcFrameCRC = args.getCalcFrameCRC();
+    if (calcFrameCRC)
+    {
+        log<level::INFO>("Skipping frames identical to the previous one",
+                         entry("CRC=%s", frameCrcImplementation()));
+    }
 }
 
 Server::~Server()
@@ -104,14 +148,22 @@ void Server::run()
 
 void Server::sendFrame()
 {
-    char* data = video.getData();
+    VideoSource::Frame frame;
     rfbClientIteratorPtr it;
     rfbClientPtr cl;
-    int64_t frame_crc = -1;
+    int64_t hextileFrame = -1;
+    bool hextileValid = false;
+    bool hextileMarked = false;
+    int64_t rgbFrame = -1;
+    int64_t keyframeFrame = -1;
+    bool keyframeValid = false;
+    bool passedOver = false;
+    bool frame_skipped = false;
     bool frame_sent = false;
+    size_t backlog = 0;
     Server* serverdata = (Server*)server->screenData;
 
-    if (!data || pendingResize)
+    if (!video.getCurrentFrame(frame) || pendingResize)
     {
         return;
     }
@@ -122,7 +174,6 @@ void Server::sendFrame()
     {
         ClientData* cd = (ClientData*)cl->clientData;
         rfbFramebufferUpdateMsg* fu = (rfbFramebufferUpdateMsg*)cl->updateBuf;
-        auto i = video.buffersDone.front();
         auto currentTime = std::chrono::steady_clock::now();
 
         if (!cd)
@@ -161,9 +212,30 @@ void Server::sendFrame()
             }
         }
 
+        // Partial-jpeg and hextile passthrough clients passed over miss
+        // what this frame changed; the others get it from the framebuffer
+        if (video.getPixelformat() == V4L2_PIX_FMT_HEXTILE)
+        {
+            // Skipping clients ask for a full frame once they are done
+            cd->passedOver =
+                !cd->skipFrame && !cd->needUpdate && hextilePassthrough(cl);
+        }
+        else
+        {
+            cd->passedOver =
+                (cd->skipFrame || !cd->needUpdate) && video.getFormat() == 2;
+        }
+        passedOver = passedOver || cd->passedOver;
+
         if (cd->skipFrame)
         {
-            cd->skipFrame--;
+            // A hextile stream only carries what changed, so the client
+            // starts from a full capture once it stops skipping frames
+            if (!--cd->skipFrame &&
+                video.getPixelformat() == V4L2_PIX_FMT_HEXTILE)
+            {
+                video.requestFullFrame();
+            }
             continue;
         }
 
@@ -172,33 +244,106 @@ void Server::sendFrame()
             continue;
         }
 
-        if (!(data[video.getFrameSize(i) - 2] == 255 &&
-              data[video.getFrameSize(i) - 1] == 217))
+        /* Skipped frames below move on to the next captured one */
+        if (!video.getCurrentFrame(frame))
         {
-            video.releaseFrames();
-            video.getFrame();
             continue;
         }
 
-        if (calcFrameCRC)
+        char* data = frame.data;
+
+        if (video.getPixelformat() == V4L2_PIX_FMT_HEXTILE)
         {
-            if (frame_crc == -1)
+            // Nothing on the screen changed
+            if (!frame.rects)
             {
-                /* JFIF header contains some varying data so skip it for
-                 * checksum calculation */
-                frame_crc =
-                    boost::crc<32, 0x04C11DB7, 0xFFFFFFFF, 0xFFFFFFFF, true,
-                               true>(data + 0x30, video.getFrameSize(i) - 0x30);
+                video.releaseFrames();
+                video.getFrame();
+                continue;
+            }
+
+            if (hextileFrame != frame.sequence)
+            {
+                hextileValid = drawHextile(frame);
+                hextileFrame = frame.sequence;
+                hextileMarked = false;
+            }
+
+            if (!hextileValid)
+            {
+                video.frameTruncated();
+                video.releaseFrames();
+                video.getFrame();
+                continue;
+            }
+
+            // Clients asking for another pixel format get the screen from
+            // the framebuffer through the libvncserver encoders
+            if (!hextilePassthrough(cl))
+            {
+                if (!hextileMarked)
+                {
+                    for (const auto& r : hextileRects)
+                    {
+                        rfbMarkRectAsModified(server, r.left, r.top,
+                                              r.left + r.width,
+                                              r.top + r.height);
+                    }
+                    hextileMarked = true;
+                }
+
+                cd->needUpdate = false;
+                frame_sent = true;
+                continue;
             }
+        }
+        else if (video.getPixelformat() == V4L2_PIX_FMT_AJPG &&
+                 !cd->aspeedJpeg)
+        {
+            // Joined while the engine captures in the ASPEED format; it
+            // goes back to jpeg now that not every client takes it
+            frame_skipped = true;
+            continue;
+        }
+        else if (video.getPixelformat() == V4L2_PIX_FMT_RGB24 &&
+                 frame.payload < video.getWidth() * video.getHeight() * 3)
+        {
+            video.frameTruncated();
+            video.releaseFrames();
+            video.getFrame();
+            continue;
+        }
+        else if (video.getPixelformat() == V4L2_PIX_FMT_JPEG &&
+                 video.getFormat() == 2 &&
+                 (!frame.box.width || !frame.box.height))
+        {
+            // Nothing on the screen changed
+            video.frameUnchanged();
+            video.releaseFrames();
+            video.getFrame();
+            continue;
+        }
+        else if (video.getPixelformat() == V4L2_PIX_FMT_JPEG &&
+                 !frame.jpeg.valid)
+        {
+            video.frameTruncated();
+            video.releaseFrames();
+            video.getFrame();
+            continue;
+        }
 
-            if (cd->last_crc == frame_crc)
+        /* The frame was hashed once when it was captured */
+        if (calcFrameCRC && frame.crc >= 0)
+        {
+            if (cd->last_crc == frame.crc)
             {
+                video.frameUnchanged();
                 video.releaseFrames();
                 video.getFrame();
                 continue;
             }
 
-            cd->last_crc = frame_crc;
+            cd->last_crc = frame.crc;
         }
 
         cd->needUpdate = false;
@@ -243,12 +388,46 @@ void Server::sendFrame()
         switch (video.getPixelformat())
         {
             case V4L2_PIX_FMT_RGB24:
-                framebuffer.assign(data, data + video.getFrameSize());
-                rfbMarkRectAsModified(server, 0, 0, video.getWidth(),
-                                      video.getHeight());
+                if (rgbFrame != frame.sequence)
+                {
+                    drawRgb(frame);
+                    rgbFrame = frame.sequence;
+                }
                 break;
 
             case V4L2_PIX_FMT_JPEG:
+            {
+                bool full = false;
+
+                // A client that missed partial frames catches up with the
+                // last composite and the frames captured after it, this one
+                // included
+                if (cd->needKeyframe && video.getFormat() == 2)
+                {
+                    if (keyframeFrame != frame.sequence)
+                    {
+                        keyframeValid =
+                            video.getKeyframe(keyframe, keyframeUpdates);
+                        keyframeFrame = frame.sequence;
+                    }
+                    full = keyframeValid;
+                    cd->needKeyframe = !full;
+                }
+
+                if (full && fu->nRects != 0xFFFF)
+                {
+                    size_t rects = 1;
+
+                    for (const auto& update : keyframeUpdates)
+                    {
+                        rects += update->regions.size();
+                    }
+                    fu->nRects = Swap16IfLE(rects);
+                }
+                else if (frame.regionCount && !full && fu->nRects != 0xFFFF)
+                {
+                    fu->nRects = Swap16IfLE(frame.regionCount);
+                }
                 fu->type = rfbFramebufferUpdate;
                 cl->ublen = sz_rfbFramebufferUpdateMsg;
                 rfbSendUpdateBuf(cl);
@@ -259,9 +438,68 @@ void Server::sendFrame()
                 else
                     cl->tightEncoding = rfbEncodingJPEG;
 
+                if (full)
+                {
+                    rfbSendTightHeader(cl, 0, 0, video.getWidth(),
+                                       video.getHeight());
+                    if (cl->tightEncodingSupport)
+                    {
+                        cl->updateBuf[cl->ublen++] = (char)(rfbTightJpeg << 4);
+                    }
+                    rfbSendCompressedDataTight(cl, keyframe.data(),
+                                               keyframe.size());
+
+                    // Re-sending a region the composite already holds is
+                    // harmless, so the queue is sent as it stands
+                    for (const auto& update : keyframeUpdates)
+                    {
+                        for (const auto& region : update->regions)
+                        {
+                            const v4l2_rect& r = region.box;
+
+                            rfbSendTightHeader(cl, r.left, r.top, r.width,
+                                               r.height);
+                            if (cl->tightEncodingSupport)
+                            {
+                                cl->updateBuf[cl->ublen++] =
+                                    (char)(rfbTightJpeg << 4);
+                            }
+                            rfbSendCompressedDataTight(
+                                cl,
+                                const_cast<char*>(update->data.data()) +
+                                    region.offset,
+                                region.size);
+                        }
+                    }
+                    rfbSendUpdateBuf(cl);
+                    break;
+                }
+
+                if (frame.regionCount)
+                {
+                    // Every changed region goes as a rectangle of its own
+                    for (unsigned int i = 0; i < frame.regionCount; i++)
+                    {
+                        const VideoSource::Region& region = frame.regions[i];
+                        const v4l2_rect& r = region.box;
+
+                        rfbSendTightHeader(cl, r.left, r.top, r.width,
+                                           r.height);
+                        if (cl->tightEncodingSupport)
+                        {
+                            cl->updateBuf[cl->ublen++] =
+                                (char)(rfbTightJpeg << 4);
+                        }
+                        rfbSendCompressedDataTight(cl, data + region.offset,
+                                                   region.size);
+                    }
+                    rfbSendUpdateBuf(cl);
+                    break;
+                }
+
                 if (video.getFormat() == 2)
                 {
-                    v4l2_rect r = video.getBoundingBox(i);
+                    v4l2_rect r = frame.box;
 
                     rfbSendTightHeader(cl, r.left, r.top, r.width, r.height);
                 }
@@ -274,8 +512,52 @@ void Server::sendFrame()
                 {
                     cl->updateBuf[cl->ublen++] = (char)(rfbTightJpeg << 4);
                 }
-                rfbSendCompressedDataTight(cl, data, video.getFrameSize(i));
+                rfbSendCompressedDataTight(cl, data, frame.payload);
+                rfbSendUpdateBuf(cl);
+                break;
+            }
+
+            case V4L2_PIX_FMT_AJPG:
+            {
+                rfbFramebufferUpdateRectHeader rect;
+                uint32_t length = Swap32IfLE((uint32_t)frame.payload);
+
+                fu->type = rfbFramebufferUpdate;
+                cl->ublen = sz_rfbFramebufferUpdateMsg;
+
+                rect.r.x = 0;
+                rect.r.y = 0;
+                rect.r.w = Swap16IfLE(video.getWidth());
+                rect.r.h = Swap16IfLE(video.getHeight());
+                rect.encoding = Swap32IfLE(aspeedJpegEncoding);
+                memcpy(&cl->updateBuf[cl->ublen], &rect,
+                       sz_rfbFramebufferUpdateRectHeader);
+                cl->ublen += sz_rfbFramebufferUpdateRectHeader;
+                memcpy(&cl->updateBuf[cl->ublen], &length, sizeof(length));
+                cl->ublen += sizeof(length);
+
+                rfbSendUpdateBuf(cl);
+                if (rfbWriteExact(cl, data, frame.payload) < 0)
+                {
+                    rfbCloseClient(cl);
+                }
+                break;
+            }
+
+            case V4L2_PIX_FMT_HEXTILE:
+                // The engine already framed every rectangle with its RFB
+                // header, so the frame goes out as captured
+                if (fu->nRects != 0xFFFF)
+                {
+                    fu->nRects = Swap16IfLE(frame.rects);
+                }
+                fu->type = rfbFramebufferUpdate;
+                cl->ublen = sz_rfbFramebufferUpdateMsg;
                 rfbSendUpdateBuf(cl);
+                if (rfbWriteExact(cl, data, frame.payload) < 0)
+                {
+                    rfbCloseClient(cl);
+                }
                 break;
 
             default:
@@ -304,12 +586,50 @@ void Server::sendFrame()
             rfbSendLastRectMarker(cl);
         }
         rfbSendUpdateBuf(cl);
+
+        recordLatency(cd, frame);
+
+        /* Bytes the slowest client still has queued steer the jpeg quality */
+        int pending = 0;
+        if (!ioctl(cl->sock, SIOCOUTQ, &pending) && pending > 0)
+        {
+            backlog = std::max(backlog, (size_t)pending);
+        }
     }
 
     rfbReleaseClientIterator(it);
 
+    if (passedOver && (frame_sent || frame_skipped) &&
+        video.getPixelformat() == V4L2_PIX_FMT_HEXTILE)
+    {
+        video.requestFullFrame();
+    }
+    else if (passedOver && (frame_sent || frame_skipped))
+    {
+        it = rfbGetClientIterator(server);
+
+        while ((cl = rfbClientIteratorNext(it)))
+        {
+            ClientData* cd = (ClientData*)cl->clientData;
+
+            if (cd && cd->passedOver)
+            {
+                cd->needKeyframe = true;
+            }
+        }
+
+        rfbReleaseClientIterator(it);
+    }
+
     if (frame_sent)
+    {
+        video.frameSent(backlog);
         video.releaseFrames();
+    }
+    else if (frame_skipped)
+    {
+        video.releaseFrames();
+    }
 }
 
 void Server::clientFramebufferUpdateRequest(
@@ -351,6 +671,13 @@ void Server::clientGone(rfbClientPtr cl)
         }
     }
 
+    logLatency(cl, cd);
+
+    if (cd->aspeedJpeg)
+    {
+        server->aspeedClients--;
+    }
+
     delete (ClientData*)cl->clientData;
     cl->clientData = nullptr;
 
@@ -363,6 +690,51 @@ void Server::clientGone(rfbClientPtr cl)
     }
 }
 
+void Server::recordLatency(ClientData* cd, const VideoSource::Frame& frame)
+{
+    auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - frame.timestamp)
+                       .count();
+    unsigned int bucket = 0;
+
+    while (bucket < latencyBuckets - 1 && latency >= (1 << bucket))
+    {
+        bucket++;
+    }
+
+    cd->latency[bucket]++;
+}
+
+void Server::logLatency(rfbClientPtr cl, const ClientData* cd)
+{
+    std::string histogram;
+    uint32_t frames = 0;
+
+    for (unsigned int bucket = 0; bucket < latencyBuckets; bucket++)
+    {
+        if (!histogram.empty())
+        {
+            histogram += ' ';
+        }
+
+        if (bucket < latencyBuckets - 1)
+        {
+            histogram += "<" + std::to_string(1 << bucket) + "ms:";
+        }
+        else
+        {
+            histogram += ">=" + std::to_string(1 << (bucket - 1)) + "ms:";
+        }
+        histogram += std::to_string(cd->latency[bucket]);
+        frames += cd->latency[bucket];
+    }
+
+    log<level::INFO>("Client capture to send latency",
+                     entry("CLIENT=%s", cl->host ? cl->host : ""),
+                     entry("FRAMES=%u", frames),
+                     entry("HISTOGRAM=%s", histogram.c_str()));
+}
+
 enum rfbNewClientAction Server::newClient(rfbClientPtr cl)
 {
     Server* server = (Server*)cl->screen->screenData;
@@ -421,6 +793,18 @@ enum rfbNewClientAction Server::newClient(rfbClientPtr cl)
         }
     }
 
+    if (server->video.getPixelformat() == V4L2_PIX_FMT_HEXTILE)
+    {
+        server->video.requestFullFrame();
+    }
+
+    // The partial-jpeg composite replaces waiting for the screen to be
+    // sent whole
+    if (server->video.getFormat() == 2 && server->video.hasKeyframe())
+    {
+        cd->skipFrame = 0;
+    }
+
     if (!server->numClients++)
     {
         server->input.connect();
@@ -431,17 +815,43 @@ enum rfbNewClientAction Server::newClient(rfbClientPtr cl)
     return RFB_CLIENT_ACCEPT;
 }
 
+rfbBool Server::enableAspeedJpeg(rfbClientPtr cl, void** data, int encoding)
+{
+    Server* server = (Server*)cl->screen->screenData;
+    ClientData* cd = (ClientData*)cl->clientData;
+
+    (void)data;
+
+    if (!cd || encoding != aspeedJpegEncoding)
+    {
+        return FALSE;
+    }
+
+    if (!cd->aspeedJpeg)
+    {
+        cd->aspeedJpeg = true;
+        server->aspeedClients++;
+    }
+
+    return TRUE;
+}
+
 void Server::doResize()
 {
     rfbClientIteratorPtr it;
     rfbClientPtr cl;
 
-    framebuffer.resize(
-        video.getHeight() * video.getWidth() * Video::bytesPerPixel, 0);
+    framebuffer.resize(video.getHeight() * video.getWidth() * bytesPerPixel(),
+                       0);
 
     rfbNewFramebuffer(server, framebuffer.data(), video.getWidth(),
-                      video.getHeight(), Video::bitsPerSample,
-                      Video::samplesPerPixel, Video::bytesPerPixel);
+                      video.getHeight(), bitsPerSample(),
+                      VideoSource::samplesPerPixel, bytesPerPixel());
+    if (video.getPixelformat() == V4L2_PIX_FMT_HEXTILE)
+    {
+        setHextileFormat();
+        video.requestFullFrame();
+    }
     rfbMarkRectAsModified(server, 0, 0, video.getWidth(), video.getHeight());
 
     it = rfbGetClientIterator(server);
@@ -463,4 +873,63 @@ void Server::doResize()
     rfbReleaseClientIterator(it);
 }
 
+void Server::setHextileFormat()
+{
+    rfbPixelFormat& format = server->serverFormat;
+
+    format.depth = 16;
+    format.redMax = 31;
+    format.greenMax = 63;
+    format.blueMax = 31;
+    format.redShift = 11;
+    format.greenShift = 5;
+    format.blueShift = 0;
+}
+
+bool Server::drawHextile(const VideoSource::Frame& frame)
+{
+    if (!decodeHextile(frame.data, frame.payload, frame.rects,
+                       video.getWidth(), video.getHeight(),
+                       (uint16_t*)framebuffer.data(), hextileRects))
+    {
+        log<level::ERR>("Invalid hextile frame",
+                        entry("RECTS=%u", frame.rects),
+                        entry("PAYLOAD=%zu", frame.payload));
+        return false;
+    }
+
+    return true;
+}
+
+void Server::drawRgb(const VideoSource::Frame& frame)
+{
+    updateRgbTiles((const uint8_t*)frame.data, (uint8_t*)framebuffer.data(),
+                   video.getWidth(), video.getHeight(), rgbRects);
+
+    for (const auto& r : rgbRects)
+    {
+        rfbMarkRectAsModified(server, r.left, r.top, r.left + r.width,
+                              r.top + r.height);
+    }
+}
+
+bool Server::hextilePassthrough(rfbClientPtr cl) const
+{
+    const rfbPixelFormat& a = cl->format;
+    const rfbPixelFormat& b = server->serverFormat;
+
+    // libvncserver only keeps the first encoding it knows of the client's
+    // SetEncodings list, so hextile is only sent to clients preferring it
+    if (cl->preferredEncoding != rfbEncodingHextile)
+    {
+        return false;
+    }
+
+    return a.bitsPerPixel == b.bitsPerPixel && a.bigEndian == b.bigEndian &&
+           a.trueColour == b.trueColour && a.redMax == b.redMax &&
+           a.greenMax == b.greenMax && a.blueMax == b.blueMax &&
+           a.redShift == b.redShift && a.greenShift == b.greenShift &&
+           a.blueShift == b.blueShift;
+}
+
 } // namespace ikvm
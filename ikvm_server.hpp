@@ -3,10 +3,26 @@
 #include "ami/include/ikvm_utils.hpp"
 #include "ikvm_args.hpp"
 #include "ikvm_input.hpp"
-#include "ikvm_video.hpp"
+#include "ikvm_video_source.hpp"
+
+#include <array>
+#include <atomic>
 
 namespace ikvm
 {
+/*
+ * @brief Number of buckets of the per-client latency histogram; bucket i
+ *        counts frames sent in under 2^i ms, the last one the slower ones
+ */
+constexpr unsigned int latencyBuckets = 12;
+
+/*
+ * @brief RFB encoding of frames forwarded as the ASPEED engine compressed
+ *        them ('AJPG'); clients advertise it in SetEncodings, the rectangle
+ *        holds a 32-bit length followed by the data
+ */
+constexpr int32_t aspeedJpegEncoding = 0x414A5047;
+
 /*
  * @class Server
  * @brief Manages the RFB server connection and updates
@@ -27,7 +43,9 @@ class Server
          * @param[in] i - Pointer to Input object
          */
 
-        ClientData(int s, Input* i) : skipFrame(s), input(i), last_crc{-1}
+        ClientData(int s, Input* i) :
+            skipFrame(s), input(i), last_crc{-1}, aspeedJpeg(false),
+            needKeyframe(true), passedOver(false), latency{}
         {
             needUpdate = false;
             lastActivityTime = std::chrono::steady_clock::now();
@@ -43,9 +61,17 @@ class Server
         Input* input;
         bool needUpdate;
         int64_t last_crc;
+        /* @brief Client takes frames in the ASPEED compressed format */
+        bool aspeedJpeg;
+        /* @brief Client missed partial-jpeg frames and needs a full one */
+        bool needKeyframe;
+        /* @brief Client didn't take the partial frame being sent */
+        bool passedOver;
         uint8_t sessionId;
         /* @brief Getting last activity time based on key and pointer event */
         std::chrono::time_point<std::chrono::steady_clock> lastActivityTime;
+        /* @brief Histogram of the capture to send latency of the frames */
+        std::array<uint32_t, latencyBuckets> latency;
     };
 
     /*
@@ -53,9 +79,10 @@ class Server
      *
      * @param[in] args - Reference to Args object
      * @param[in] i    - Reference to Input object
-     * @param[in] v    - Reference to Video object
+     * @param[in] v    - Reference to the video source
+     * @param[in] head - Index of the device set, offsets the listening port
      */
-    Server(const Args& args, Input& i, Video& v);
+    Server(const Args& args, Input& i, VideoSource& v, unsigned int head = 0);
     ~Server();
     Server(const Server&) = default;
     Server& operator=(const Server&) = default;
@@ -79,11 +106,21 @@ class Server
         return server->clientHead;
     }
     /*
-     * @brief Get the Video object
+     * @brief Indicates whether every client takes the ASPEED compressed
+     *        format, so the engine can capture in it
+     *
+     * @return Boolean to indicate whether to capture ASPEED jpeg frames
+     */
+    inline bool wantsAspeedJpeg() const
+    {
+        return numClients && aspeedClients == numClients;
+    }
+    /*
+     * @brief Get the video source
      *
-     * @return Reference to the Video object
+     * @return Reference to the video source
      */
-    inline const Video& getVideo() const
+    inline const VideoSource& getVideo() const
     {
         return video;
     }
@@ -109,10 +146,86 @@ class Server
      * @param[in] cl - Handle to the client object
      */
     static enum rfbNewClientAction newClient(rfbClientPtr cl);
+    /*
+     * @brief Handler for a client advertising the ASPEED jpeg encoding
+     *
+     * @param[in] cl       - Handle to the client object
+     * @param[in] data     - Extension data of the client, unused
+     * @param[in] encoding - Encoding the client advertised
+     *
+     * @return Boolean to indicate whether the encoding was taken
+     */
+    static rfbBool enableAspeedJpeg(rfbClientPtr cl, void** data,
+                                    int encoding);
 
     /* @brief Performs the resize operation on the framebuffer */
     void doResize();
 
+    /*
+     * @brief Gets the number of bits per component of a framebuffer pixel
+     *
+     * @return 5 for the 16-bit pixels of hextile frames, 8 otherwise
+     */
+    inline int bitsPerSample() const
+    {
+        return video.getPixelformat() == V4L2_PIX_FMT_HEXTILE
+                   ? 5
+                   : VideoSource::bitsPerSample;
+    }
+    /*
+     * @brief Gets the number of bytes of storage for a framebuffer pixel
+     *
+     * @return 2 for the 16-bit pixels of hextile frames, 4 otherwise
+     */
+    inline int bytesPerPixel() const
+    {
+        return video.getPixelformat() == V4L2_PIX_FMT_HEXTILE
+                   ? 2
+                   : VideoSource::bytesPerPixel;
+    }
+    /* @brief Sets the RGB565 pixel format of the NPCM hextile frames */
+    void setHextileFormat();
+    /*
+     * @brief Draws the rectangles of a hextile frame into the framebuffer
+     *
+     * @param[in] frame - Descriptor of the frame
+     *
+     * @return Boolean indicating if the frame holds valid rectangles
+     */
+    bool drawHextile(const VideoSource::Frame& frame);
+    /*
+     * @brief Converts an RGB24 frame into the framebuffer and marks the
+     *        tiles that changed since the previous one
+     *
+     * @param[in] frame - Descriptor of the frame
+     */
+    void drawRgb(const VideoSource::Frame& frame);
+    /*
+     * @brief Gets whether a client can take hextile frames as captured
+     *
+     * @param[in] cl - Handle to the client object
+     *
+     * @return Boolean indicating if the client asked for hextile and uses
+     *         the server pixel format
+     */
+    bool hextilePassthrough(rfbClientPtr cl) const;
+
+    /*
+     * @brief Accounts the time from capture until the frame was handed to
+     *        the client socket
+     *
+     * @param[in] cd    - Pointer to the client data
+     * @param[in] frame - Descriptor of the sent frame
+     */
+    static void recordLatency(ClientData* cd, const VideoSource::Frame& frame);
+    /*
+     * @brief Logs the latency histogram of a client
+     *
+     * @param[in] cl - Handle to the client object
+     * @param[in] cd - Pointer to the client data
+     */
+    static void logLatency(rfbClientPtr cl, const ClientData* cd);
+
     /*
      * @brief Updates USB Power Save Mode Status. (AMI Extension)
      *
@@ -125,19 +238,30 @@ class Server
     /* @brief Number of frames handled since a client connected */
     int frameCounter;
     /* @brief Number of connected clients */
-    unsigned int numClients;
-    /* @brief Microseconds to process RFB events every frame */
+    std::atomic<unsigned int> numClients;
+    /* @brief Number of clients taking the ASPEED compressed format */
+    std::atomic<unsigned int> aspeedClients;
+    /* @brief Microseconds to process RFB events every frame, shared out
+     *        among the device sets */
     long int processTime;
     /* @brief Handle to the RFB server object */
     rfbScreenInfoPtr server;
     /* @brief Reference to the Input object */
     Input& input;
-    /* @brief Reference to the Video object */
-    Video& video;
+    /* @brief Reference to the video source */
+    VideoSource& video;
     /* @brief Default framebuffer storage */
     std::vector<char> framebuffer;
     /* @brief Identical frames detection */
     bool calcFrameCRC;
+    /* @brief Rectangles of the last drawn hextile frame */
+    std::vector<v4l2_rect> hextileRects;
+    /* @brief Changed tiles of the last converted RGB24 frame */
+    std::vector<v4l2_rect> rgbRects;
+    /* @brief Composited full screen jpeg for clients that fell behind */
+    std::vector<char> keyframe;
+    /* @brief Frames captured after the composited jpeg */
+    VideoSource::Updates keyframeUpdates;
     /* @brief Cursor bitmap width */
     static constexpr int cursorWidth = 20;
     /* @brief Cursor bitmap height */
@@ -1,13 +1,15 @@
 #include "ikvm_video.hpp"
 
+#include "ikvm_crc.hpp"
+
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/videodev2.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
-#include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -19,22 +21,42 @@
 #include <xyz/openbmc_project/Common/Device/error.hpp>
 #include <xyz/openbmc_project/Common/File/error.hpp>
 
+#include <algorithm>
+
 #define V4L2_PIX_FMT_FLAG_PARTIAL_JPG 0x00000004
 
 namespace ikvm
 {
-const int Video::bitsPerSample(8);
-const int Video::bytesPerPixel(4);
-const int Video::samplesPerPixel(3);
+const int VideoSource::bitsPerSample(8);
+const int VideoSource::bytesPerPixel(4);
+const int VideoSource::samplesPerPixel(3);
 
 using namespace phosphor::logging;
 using namespace sdbusplus::xyz::openbmc_project::Common::File::Error;
 using namespace sdbusplus::xyz::openbmc_project::Common::Device::Error;
 
-Video::Video(const std::string& p, Input& input, int fr, int sub, int fmt) :
-    resizeAfterOpen(false), timingsError(false), fd(-1), frameRate(fr),
-    height(600), width(800), subSampling(sub), input(input), format(fmt),
-    originalFormat(fmt), path(p), pixelformat(V4L2_PIX_FMT_JPEG)
+Video::Video(const std::string& p, Input& input, int fr, int sub, int fmt,
+             unsigned int bufs, bool adaptBufs, int q, uint32_t kbps,
+             bool adaptRate) :
+    resizeAfterOpen(false), timingsError(false), sourceEvents(false),
+    sourceChanged(true), signalState(SignalState::Signal),
+    reprobeDelay(minReprobe), powerOnsSeen(hostPowerOnCount), fd(-1),
+    epollFd(-1), frameWait(frameTimeout), frameRate(fr), captureRate(fr),
+    requestedRate(fr), adaptiveRate(adaptRate), unattended(false), height(600),
+    width(800), subSampling(sub ? 1 : 0), requestedSubsampling(sub ? 1 : 0),
+    adaptiveSubsampling(sub == 2), captureMode(-1), fullFrameRequested(true),
+    regionsSupported(false), lastPayload(0), input(input), format(fmt),
+    originalFormat(fmt), requestedFormat(fmt), path(p), baseBuffers(bufs),
+    requestedBuffers(bufs), bufferCount(0), adaptiveBuffers(adaptBufs),
+    bufferReason("requested"), lastSequence(-1), windowFrames(0), windowGaps(0),
+    windowStarved(0), quietWindows(0), droppedFrames(0), errorFrames(0),
+    truncatedFrames(0), unchangedFrames(0), exportIndex(-1),
+    exportGeneration(0), leaseIndex(-1), leaseWanted(false), quality(-1),
+    requestedQuality(q), qualityMin(0), qualityMax(0), rateControl(kbps),
+    hashing(false), noSignalImage(NO_SIGNAL_IMG_PATH),
+    powerOffImage(POWER_OFF_IMG_PATH), placeholder(nullptr),
+    placeholderJpeg{}, placeholderCrc(-1),
+    pixelformat(fmt == 3 ? V4L2_PIX_FMT_HEXTILE : V4L2_PIX_FMT_JPEG)
 {}
 
 Video::~Video()
@@ -58,92 +80,1052 @@ char* Video::getData(unsigned int i)
     {
         return nullptr;
     }
-    return (char*)buffers[i].data;
+    return (char*)buffers[i].data;
+}
+
+void Video::getFrame()
+{
+    int rc(0);
+    bool ready(false);
+    v4l2_buffer buf;
+    epoll_event events[2];
+
+    if (fd < 0)
+    {
+        return;
+    }
+
+    returnLeased();
+
+    // Don't get more new frames until we run out of previous ones
+    if (!buffersDone.empty() || placeholder)
+    {
+        return;
+    }
+
+    // Every buffer is back with the driver, so this is the point to apply a
+    // new capture format or ring depth without dropping a frame that is
+    // still being sent
+    if (requestedFormat != format)
+    {
+        adjustFormat();
+    }
+    else if (requestedBuffers != bufferCount)
+    {
+        adjustBuffers();
+    }
+
+    if (quality >= 0 && requestedQuality != quality)
+    {
+        adjustQuality();
+    }
+
+    if (requestedSubsampling != subSampling)
+    {
+        adjustSubsampling();
+    }
+
+    if (!adaptiveRate)
+    {
+        requestedRate = frameRate;
+    }
+
+    if (unattended)
+    {
+        requestedRate = std::min(frameRate, unattendedRate);
+    }
+
+    if (requestedRate != captureRate)
+    {
+        adjustFrameRate();
+    }
+
+    if (pixelformat == V4L2_PIX_FMT_HEXTILE)
+    {
+        adjustCaptureMode();
+    }
+
+    // The device is opened non-blocking and registered edge-triggered, so
+    // wake up as soon as the driver completes a buffer. The wait is cut
+    // short when other device sets share the capture loop.
+    rc = epoll_wait(epollFd, events, 2, frameWait);
+    if (rc < 0)
+    {
+        if (errno != EINTR)
+        {
+            log<level::ERR>("Failed to wait for video frame",
+                            entry("ERROR=%s", strerror(errno)));
+        }
+        return;
+    }
+    else if (!rc)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        // The timeout only expires when no frame arrives at all, i.e. the
+        // video signal is lost
+        if (now - lastFrameAt < std::chrono::milliseconds(frameTimeout))
+        {
+            return;
+        }
+        lastFrameAt = now;
+
+        // No frame within the timeout; re-check the timings in case the
+        // driver lost the signal without raising a source change event
+        sourceChanged = true;
+
+        if (signalState != SignalState::Signal)
+        {
+            placeholderFrame();
+        }
+        return;
+    }
+
+    for (int i = 0; i < rc; i++)
+    {
+        if (events[i].data.fd != fd)
+        {
+            wakeFrameRate();
+            continue;
+        }
+
+        if (events[i].events & EPOLLPRI)
+        {
+            dqevents();
+        }
+
+        ready = true;
+    }
+
+    // Woken up by input activity alone; the frame is still to come
+    if (!ready)
+    {
+        return;
+    }
+
+    memset(&buf, 0, sizeof(v4l2_buffer));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+
+    // Edge-triggered readiness is only signalled again for new buffers, so
+    // drain everything the driver has completed until it returns EAGAIN
+    do
+    {
+        rc = ioctl(fd, VIDIOC_DQBUF, &buf);
+        if (rc >= 0)
+        {
+            buffers[buf.index].queued = false;
+            lastFrameAt = std::chrono::steady_clock::now();
+
+            if (lastSequence >= 0 && buf.sequence > lastSequence + 1)
+            {
+                windowGaps += buf.sequence - lastSequence - 1;
+                droppedFrames += buf.sequence - lastSequence - 1;
+            }
+            lastSequence = buf.sequence;
+            windowFrames++;
+
+            if (!(buf.flags & V4L2_BUF_FLAG_ERROR))
+            {
+                std::lock_guard<std::mutex> guard(exportMutex);
+
+                buffers[buf.index].payload = buf.bytesused;
+                buffers[buf.index].sequence = buf.sequence;
+
+                // Monotonic driver timestamps share their clock with
+                // steady_clock, so latency can be measured from the moment
+                // the engine completed the frame
+                if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+                    V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+                {
+                    buffers[buf.index].timestamp =
+                        std::chrono::steady_clock::time_point(
+                            std::chrono::seconds(buf.timestamp.tv_sec) +
+                            std::chrono::microseconds(buf.timestamp.tv_usec));
+                }
+                else
+                {
+                    buffers[buf.index].timestamp =
+                        std::chrono::steady_clock::now();
+                }
+                buffers[buf.index].regionCount = 0;
+                if (format == 2)
+                {
+                    const v4l2_rect& box = buffers[buf.index].box;
+
+                    getRegions(buffers[buf.index]);
+
+                    // The engine reports an empty box when nothing on the
+                    // screen changed since the previous frame
+                    governFrame(!box.width || !box.height);
+
+                    // Every frame goes to the composite, sent or not
+                    if (box.width && box.height)
+                    {
+                        const Buffer& b = buffers[buf.index];
+
+                        keyframe.submit((const char*)b.data, b.payload, box,
+                                        b.regionCount ? b.regions.data()
+                                                      : nullptr,
+                                        b.regionCount);
+                    }
+                }
+                else
+                {
+                    buffers[buf.index].box = {0, 0, (uint32_t)width,
+                                              (uint32_t)height};
+                }
+
+                // Headers are walked once here rather than per client
+                buffers[buf.index].jpeg = {};
+                if (pixelformat == V4L2_PIX_FMT_JPEG)
+                {
+                    describeJpeg(buffers[buf.index]);
+                }
+
+                // The jpeg headers contain some varying data, so only the
+                // entropy-coded data is hashed
+                buffers[buf.index].crc = -1;
+                if (hashing && pixelformat != V4L2_PIX_FMT_HEXTILE)
+                {
+                    Buffer& b = buffers[buf.index];
+                    size_t skip = std::min<size_t>(b.jpeg.scanOffset,
+                                                   b.payload);
+
+                    b.crc = frameCrc((const char*)b.data + skip,
+                                     b.payload - skip);
+                }
+
+                buffers[buf.index].rects = 0;
+                if (pixelformat == V4L2_PIX_FMT_HEXTILE)
+                {
+                    v4l2_control ctrl = {.id = V4L2_CID_NPCM_RECT_COUNT};
+
+                    // The engine counts the rectangles of the buffer that
+                    // was dequeued last
+                    if (ioctl(fd, VIDIOC_G_CTRL, &ctrl) < 0)
+                    {
+                        log<level::ERR>("Failed to get rectangle count",
+                                        entry("ERROR=%s", strerror(errno)));
+                        ctrl.value = 0;
+                    }
+                    buffers[buf.index].rects = ctrl.value;
+
+                    // Nothing to send when nothing on the screen changed
+                    governFrame(!ctrl.value);
+                }
+
+                // Only jpeg frames make up a sequence that can be looked at
+                // later; the log has no room for other pixel formats
+                if ((recorder || flightRecorder) &&
+                    pixelformat == V4L2_PIX_FMT_JPEG)
+                {
+                    recordFrame(buffers[buf.index]);
+                }
+                buffersDone.push_back(buf.index);
+                exportIndex = buf.index;
+
+                // A caller found the previous frame back with the driver
+                if (leaseWanted)
+                {
+                    leaseIndex = buf.index;
+                    leaseExpiry = std::chrono::steady_clock::now() +
+                                  leaseTimeout;
+                    leaseWanted = false;
+                }
+            }
+            else
+            {
+                errorFrames++;
+                buffers[buf.index].payload = 0;
+                qbuf(buf.index);
+            }
+        }
+    } while (rc >= 0);
+
+    // The driver had no buffer left to capture into, so it is dropping
+    // frames until one is released
+    if (std::none_of(buffers.begin(), buffers.end(),
+                     [](const Buffer& b) { return b.queued; }))
+    {
+        windowStarved++;
+    }
+
+    if (adaptiveBuffers)
+    {
+        adaptBuffers();
+    }
+}
+
+bool Video::getCurrentFrame(Frame& frame) const
+{
+    if (buffersDone.empty() && placeholder)
+    {
+        frame.index = buffers.size();
+        frame.data = const_cast<char*>(placeholder->data());
+        frame.payload = placeholder->size();
+        frame.sequence = UINT32_MAX;
+        frame.box = {0, 0, (uint32_t)width, (uint32_t)height};
+        frame.rects = 0;
+        frame.regions = nullptr;
+        frame.regionCount = 0;
+        frame.jpeg = placeholderJpeg;
+        frame.crc = placeholderCrc;
+        frame.timestamp = nextPlaceholder - placeholderInterval;
+        return true;
+    }
+
+    if (buffersDone.empty())
+    {
+        return false;
+    }
+
+    const Buffer& buffer = buffers[buffersDone.front()];
+
+    frame.index = buffersDone.front();
+    frame.data = (char*)buffer.data;
+    frame.payload = buffer.payload;
+    frame.sequence = buffer.sequence;
+    frame.box = buffer.box;
+    frame.rects = buffer.rects;
+    frame.regions = buffer.regionCount ? buffer.regions.data() : nullptr;
+    frame.regionCount = buffer.regionCount;
+    frame.jpeg = buffer.jpeg;
+    frame.crc = buffer.crc;
+    frame.timestamp = buffer.timestamp;
+
+    return true;
+}
+
+int Video::exportFrame(ExportedFrame& frame)
+{
+    std::lock_guard<std::mutex> guard(exportMutex);
+
+    if (buffers.empty() || buffers.front().dmabuf < 0)
+    {
+        return -ENODATA;
+    }
+
+    // A leased buffer is off the ring, and capture stalls on the last one
+    if (bufferCount <= 2)
+    {
+        return -EBUSY;
+    }
+
+    if (exportIndex < 0)
+    {
+        leaseWanted = true;
+        return -EAGAIN;
+    }
+
+    const Buffer& buffer = buffers[exportIndex];
+
+    // Only one lease at a time; a buffer leased before goes back to the
+    // driver with the next frame
+    leaseIndex = exportIndex;
+    leaseExpiry = std::chrono::steady_clock::now() + leaseTimeout;
+    leaseWanted = false;
+
+    frame.index = exportIndex;
+    frame.generation = exportGeneration;
+    frame.size = buffer.size;
+    frame.payload = buffer.payload;
+    frame.sequence = buffer.sequence;
+    frame.box = buffer.box;
+    frame.width = width;
+    frame.height = height;
+    frame.pixelformat = pixelformat;
+    frame.format = format;
+
+    int dup = fcntl(buffer.dmabuf, F_DUPFD_CLOEXEC, 0);
+
+    return dup < 0 ? -errno : dup;
+}
+
+void Video::releaseExport(unsigned int index, uint32_t generation)
+{
+    std::lock_guard<std::mutex> guard(exportMutex);
+
+    if (generation == exportGeneration && (int)index == leaseIndex)
+    {
+        leaseIndex = -1;
+    }
+}
+
+void Video::returnLeased()
+{
+    std::vector<int> ended;
+
+    {
+        std::lock_guard<std::mutex> guard(exportMutex);
+
+        if (leaseIndex >= 0 &&
+            std::chrono::steady_clock::now() >= leaseExpiry)
+        {
+            leaseIndex = -1;
+        }
+
+        for (auto it = leasedBuffers.begin(); it != leasedBuffers.end();)
+        {
+            if (*it != leaseIndex)
+            {
+                ended.push_back(*it);
+                it = leasedBuffers.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    for (int i : ended)
+    {
+        qbuf(i);
+    }
+}
+
+void Video::frameSent(size_t backlog)
+{
+    size_t payload;
+    bool constrained;
+
+    if (buffersDone.empty())
+    {
+        return;
+    }
+
+    payload = buffers[buffersDone.front()].payload;
+
+    // Partial and hextile frames already told the governor whether they
+    // changed
+    if (format != 2 && format != 3)
+    {
+        governFrame(false);
+    }
+
+    if (quality >= 0)
+    {
+        requestedQuality = rateControl.update(payload, backlog, captureRate,
+                                              quality, qualityMin, qualityMax);
+    }
+
+    if (adaptiveSubsampling)
+    {
+        // Bandwidth is tight once the rate controller has run out of quality
+        // to give up, or half a second of frames is still queued to a client
+        constrained = (rateControl.getTarget() && quality >= 0 &&
+                       quality <= qualityMin) ||
+                      backlog > payload * std::max(captureRate.load(), 1) / 2;
+
+        requestedSubsampling = chromaPolicy.update(
+            frameChange(), constrained, captureRate, requestedSubsampling);
+    }
+}
+
+void Video::frameUnchanged()
+{
+    // A placeholder repeats by design and says nothing about the screen
+    if (buffersDone.empty())
+    {
+        return;
+    }
+
+    unchangedFrames++;
+    governFrame(true);
+}
+
+Video::Counters Video::getCounters() const
+{
+    Counters counters;
+
+    counters.dropped = droppedFrames;
+    counters.errors = errorFrames;
+    counters.truncated = truncatedFrames;
+    counters.unchanged = unchangedFrames;
+
+    return counters;
+}
+
+void Video::record(const std::string& logPath)
+{
+    recorder.reset();
+
+    if (!logPath.empty())
+    {
+        recorder = std::make_unique<FrameLogWriter>(logPath);
+    }
+}
+
+void Video::keepFrames(std::chrono::seconds window, size_t bytes)
+{
+    flightRecorder.reset();
+
+    if (window.count() > 0 && bytes)
+    {
+        flightRecorder = std::make_unique<FlightRecorder>(window, bytes);
+    }
+}
+
+void Video::saveRecentFrames(const std::string& path)
+{
+    if (flightRecorder)
+    {
+        flightRecorder->save(path);
+    }
+}
+
+void Video::setUnattended(bool idle)
+{
+    if (idle == unattended)
+    {
+        return;
+    }
+
+    unattended = idle;
+
+    // Viewers get the full rate back at once
+    if (!idle)
+    {
+        governor.reset();
+        requestedRate = frameRate;
+    }
+}
+
+void Video::recordFrame(const Buffer& buffer)
+{
+    FrameLogRecord record;
+    auto append = [this](const FrameLogRecord& r, const char* data) {
+        if (recorder)
+        {
+            recorder->append(r, data);
+        }
+        if (flightRecorder)
+        {
+            flightRecorder->append(r, data);
+        }
+    };
+
+    memset(&record, 0, sizeof(record));
+    record.payload = buffer.payload;
+    record.sequence = buffer.sequence;
+    record.format = format;
+    record.subsampling = subSampling;
+    record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           buffer.timestamp.time_since_epoch())
+                           .count();
+    record.width = width;
+    record.height = height;
+    record.left = buffer.box.left;
+    record.top = buffer.box.top;
+    record.boxWidth = buffer.box.width;
+    record.boxHeight = buffer.box.height;
+
+    if (!buffer.regionCount)
+    {
+        append(record, (const char*)buffer.data);
+        return;
+    }
+
+    // Every region is a jpeg of its own, replayed one after the other
+    for (unsigned int i = 0; i < buffer.regionCount; i++)
+    {
+        const Region& region = buffer.regions[i];
+
+        record.payload = region.size;
+        record.left = region.box.left;
+        record.top = region.box.top;
+        record.boxWidth = region.box.width;
+        record.boxHeight = region.box.height;
+        append(record, (const char*)buffer.data + region.offset);
+    }
+}
+
+void Video::getRegions(Buffer& buffer)
+{
+    v4l2_selection comp = {.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                           .target = V4L2_SEL_TGT_CROP_DEFAULT};
+
+    if (regionsSupported)
+    {
+        v4l2_ext_control ctrl;
+        v4l2_ext_controls ctrls;
+
+        memset(&ctrl, 0, sizeof(ctrl));
+        memset(&ctrls, 0, sizeof(ctrls));
+        ctrl.id = V4L2_CID_ASPEED_JPEG_REGIONS;
+        ctrl.size = sizeof(buffer.regions);
+        ctrl.ptr = buffer.regions.data();
+        ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+        ctrls.count = 1;
+        ctrls.controls = &ctrl;
+
+        if (ioctl(fd, VIDIOC_G_EXT_CTRLS, &ctrls) < 0)
+        {
+            if (errno == EINVAL || errno == ENOTTY)
+            {
+                log<level::INFO>("Driver doesn't list partial-jpeg regions");
+                regionsSupported = false;
+            }
+            else
+            {
+                log<level::ERR>("Failed to get partial-jpeg regions",
+                                entry("ERROR=%s", strerror(errno)));
+            }
+        }
+        else
+        {
+            unsigned int count =
+                std::min<unsigned int>(ctrl.size / sizeof(Region), maxRegions);
+            int32_t left = width;
+            int32_t top = height;
+            uint32_t right = 0;
+            uint32_t bottom = 0;
+            unsigned int i;
+
+            for (i = 0; i < count; i++)
+            {
+                const Region& region = buffer.regions[i];
+                const v4l2_rect& r = region.box;
+
+                if (r.left < 0 || r.top < 0 || !r.width || !r.height ||
+                    r.left + r.width > width || r.top + r.height > height ||
+                    region.size < 2 ||
+                    (size_t)region.offset + region.size > buffer.payload)
+                {
+                    break;
+                }
+
+                left = std::min(left, r.left);
+                top = std::min(top, r.top);
+                right = std::max(right, r.left + r.width);
+                bottom = std::max(bottom, r.top + r.height);
+            }
+
+            if (i == count)
+            {
+                buffer.regionCount = count;
+                buffer.box = {0, 0, 0, 0};
+                if (count)
+                {
+                    buffer.box = {left, top, right - left, bottom - top};
+                }
+                return;
+            }
+
+            log<level::ERR>("Invalid partial-jpeg region",
+                            entry("REGION=%u", i), entry("COUNT=%u", count),
+                            entry("PAYLOAD=%zu", buffer.payload));
+        }
+    }
+
+    if (ioctl(fd, VIDIOC_G_SELECTION, &comp))
+    {
+        log<level::ERR>("Failed to get selection box",
+                        entry("ERROR=%s", strerror(errno)));
+        comp.r.left = 0;
+        comp.r.top = 0;
+        comp.r.width = width;
+        comp.r.height = height;
+    }
+    buffer.regionCount = 0;
+    buffer.box = comp.r;
+}
+
+bool Video::probeRegions()
+{
+#ifdef ASPEED_JPEG_REGIONS
+    v4l2_query_ext_ctrl qctrl;
+
+    memset(&qctrl, 0, sizeof(v4l2_query_ext_ctrl));
+    qctrl.id = V4L2_CID_ASPEED_JPEG_REGIONS;
+    if (ioctl(fd, VIDIOC_QUERY_EXT_CTRL, &qctrl) < 0 ||
+        (qctrl.flags & V4L2_CTRL_FLAG_DISABLED))
+    {
+        log<level::INFO>("Driver doesn't list partial-jpeg regions");
+        return false;
+    }
+
+    // Another control may sit at this id on an unpatched driver
+    if (qctrl.type < V4L2_CTRL_COMPOUND_TYPES ||
+        qctrl.elem_size != sizeof(Region) ||
+        !(qctrl.flags & V4L2_CTRL_FLAG_DYNAMIC_ARRAY) ||
+        qctrl.nr_of_dims != 1 || qctrl.dims[0] > maxRegions)
+    {
+        log<level::WARNING>("Unexpected partial-jpeg regions control",
+                            entry("TYPE=%u", qctrl.type),
+                            entry("ELEM_SIZE=%u", qctrl.elem_size),
+                            entry("FLAGS=0x%x", qctrl.flags),
+                            entry("DIMS=%u", qctrl.dims[0]));
+        return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Video::describeJpeg(Buffer& buffer)
+{
+    const char* data = (const char*)buffer.data;
+    JpegInfo region;
+
+    if (!buffer.regionCount)
+    {
+        parseJpeg(data, buffer.payload, buffer.jpeg);
+        return;
+    }
+
+    // The jpeg of the first region stands for the frame; offsets are into
+    // the whole frame data
+    for (unsigned int i = 0; i < buffer.regionCount; i++)
+    {
+        const Region& r = buffer.regions[i];
+
+        if (!parseJpeg(data + r.offset, r.size, region))
+        {
+            buffer.jpeg.valid = false;
+            return;
+        }
+
+        if (!i)
+        {
+            buffer.jpeg = region;
+            buffer.jpeg.sosOffset += r.offset;
+            buffer.jpeg.scanOffset += r.offset;
+        }
+        buffer.jpeg.eoiOffset = r.offset + region.eoiOffset;
+    }
+}
+
+void Video::governFrame(bool unchanged)
+{
+    if (adaptiveRate)
+    {
+        requestedRate = governor.update(unchanged, frameRate, requestedRate);
+    }
+}
+
+void Video::wakeFrameRate()
+{
+    uint64_t count;
+
+    while (read(input.getActivityFd(), &count, sizeof(count)) > 0)
+    {}
+
+    if (adaptiveRate && captureRate != frameRate)
+    {
+        governor.reset();
+        requestedRate = frameRate;
+        adjustFrameRate();
+    }
+}
+
+void Video::adjustFrameRate()
+{
+    int rc;
+    v4l2_streamparm sparm;
+
+    memset(&sparm, 0, sizeof(v4l2_streamparm));
+    sparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sparm.parm.capture.timeperframe.numerator = 1;
+    sparm.parm.capture.timeperframe.denominator = requestedRate;
+    rc = ioctl(fd, VIDIOC_S_PARM, &sparm);
+    if (rc < 0)
+    {
+        log<level::WARNING>("Failed to set video capture frame rate",
+                            entry("RATE=%d", requestedRate),
+                            entry("ERROR=%s", strerror(errno)));
+        requestedRate = captureRate;
+        return;
+    }
+
+    log<level::DEBUG>("Changed video capture frame rate",
+                      entry("FROM=%d", captureRate.load()),
+                      entry("TO=%d", requestedRate));
+
+    captureRate = requestedRate;
+}
+
+void Video::adjustCaptureMode()
+{
+    int rc;
+    v4l2_control ctrl;
+    int mode = fullFrameRequested.exchange(false)
+                   ? V4L2_NPCM_CAPTURE_MODE_COMPLETE
+                   : V4L2_NPCM_CAPTURE_MODE_DIFF;
+
+    if (mode == captureMode)
+    {
+        return;
+    }
+
+    // Only changed rectangles are captured in diff mode, so a new client
+    // needs one complete capture to start from
+    ctrl.id = V4L2_CID_NPCM_CAPTURE_MODE;
+    ctrl.value = mode;
+    rc = ioctl(fd, VIDIOC_S_CTRL, &ctrl);
+    if (rc < 0)
+    {
+        log<level::WARNING>("Failed to set video capture mode",
+                            entry("MODE=%d", mode),
+                            entry("ERROR=%s", strerror(errno)));
+    }
+
+    captureMode = mode;
+}
+
+unsigned int Video::frameChange()
+{
+    const Buffer& buffer = buffers[buffersDone.front()];
+    size_t payload = buffer.payload;
+    size_t last = lastPayload;
+    size_t delta = payload > last ? payload - last : last - payload;
+
+    if (format == 2)
+    {
+        if (!width || !height)
+        {
+            return 1000;
+        }
+
+        uint64_t area = (uint64_t)buffer.box.width * buffer.box.height;
+
+        if (buffer.regionCount)
+        {
+            area = 0;
+            for (unsigned int i = 0; i < buffer.regionCount; i++)
+            {
+                area += (uint64_t)buffer.regions[i].box.width *
+                        buffer.regions[i].box.height;
+            }
+        }
+
+        return std::min<uint64_t>(area * 1000 / (width * height), 1000);
+    }
+
+    // A full frame carries no damage information, but the encoder output of
+    // an unchanged screen has the same size frame after frame
+    lastPayload = payload;
+    if (delta > last / 64)
+    {
+        return 1000;
+    }
+
+    return 0;
+}
+
+void Video::adjustQuality()
+{
+    int rc;
+    v4l2_control ctrl;
+
+    ctrl.id = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+    ctrl.value = std::clamp(requestedQuality.load(), qualityMin, qualityMax);
+    rc = ioctl(fd, VIDIOC_S_CTRL, &ctrl);
+    if (rc < 0)
+    {
+        log<level::WARNING>("Failed to set video jpeg quality",
+                            entry("QUALITY=%d", ctrl.value),
+                            entry("ERROR=%s", strerror(errno)));
+        requestedQuality = quality.load();
+        return;
+    }
+
+    quality = ctrl.value;
+    requestedQuality = ctrl.value;
+}
+
+void Video::adjustSubsampling()
+{
+    int rc;
+    v4l2_control ctrl;
+    int sub = requestedSubsampling;
+
+    ctrl.id = V4L2_CID_JPEG_CHROMA_SUBSAMPLING;
+    ctrl.value = sub ? V4L2_JPEG_CHROMA_SUBSAMPLING_420
+                     : V4L2_JPEG_CHROMA_SUBSAMPLING_444;
+    rc = ioctl(fd, VIDIOC_S_CTRL, &ctrl);
+    if (rc < 0)
+    {
+        log<level::WARNING>("Failed to set video jpeg subsampling",
+                            entry("SUBSAMPLING=%d", sub),
+                            entry("ERROR=%s", strerror(errno)));
+        requestedSubsampling = subSampling.load();
+        return;
+    }
+
+    log<level::INFO>("Changed video jpeg subsampling",
+                     entry("SUBSAMPLING=%s", sub ? "420" : "444"),
+                     entry("ADAPTIVE=%d", adaptiveSubsampling.load()));
+
+    subSampling = sub;
+}
+
+void Video::setBufferCount(unsigned int count)
+{
+    count = std::clamp(count, minBuffers, maxBuffers);
+
+    baseBuffers = count;
+    bufferReason = "requested";
+    requestedBuffers = count;
+}
+
+void Video::adaptBuffers()
+{
+    unsigned int count = requestedBuffers;
+    unsigned int window = std::max(captureRate.load(), 1) * adaptWindowSeconds;
+
+    if (windowFrames < window)
+    {
+        return;
+    }
+
+    if (windowStarved >= adaptThreshold || windowGaps >= adaptThreshold)
+    {
+        quietWindows = 0;
+
+        if (count < maxBuffers)
+        {
+            bufferReason = windowStarved >= adaptThreshold
+                               ? "dequeue starvation"
+                               : "sequence gaps";
+            requestedBuffers = count + 1;
+        }
+    }
+    else if (!windowStarved && !windowGaps)
+    {
+        if (++quietWindows >= adaptQuietWindows && count > baseBuffers)
+        {
+            quietWindows = 0;
+            bufferReason = "no starvation or sequence gaps";
+            requestedBuffers = count - 1;
+        }
+    }
+    else
+    {
+        quietWindows = 0;
+    }
+
+    if (requestedBuffers != count)
+    {
+        log<level::INFO>("Adapting video buffer ring depth",
+                         entry("FROM=%u", count),
+                         entry("TO=%u", requestedBuffers.load()),
+                         entry("FRAMES=%u", windowFrames),
+                         entry("STARVED=%u", windowStarved),
+                         entry("GAPS=%u", windowGaps));
+    }
+
+    windowFrames = 0;
+    windowGaps = 0;
+    windowStarved = 0;
+}
+
+void Video::setPixFormat(v4l2_format& fmt) const
+{
+    switch (format)
+    {
+        case 1:
+            fmt.fmt.pix.flags &= ~V4L2_PIX_FMT_FLAG_PARTIAL_JPG;
+            fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_AJPG;
+            break;
+        case 2:
+            fmt.fmt.pix.flags |= V4L2_PIX_FMT_FLAG_PARTIAL_JPG;
+            fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_JPEG;
+            break;
+        case 3:
+            fmt.fmt.pix.flags &= ~V4L2_PIX_FMT_FLAG_PARTIAL_JPG;
+            fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_HEXTILE;
+            break;
+        default:
+        case 0:
+            fmt.fmt.pix.flags &= ~V4L2_PIX_FMT_FLAG_PARTIAL_JPG;
+            fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_JPEG;
+            break;
+    }
 }
 
-void Video::getFrame()
+void Video::adjustFormat()
 {
-    int rc(0);
-    int fd_flags;
-    v4l2_buffer buf;
-    fd_set fds;
-    timeval tv;
-    v4l2_selection comp = {.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-                           .target = V4L2_SEL_TGT_CROP_DEFAULT};
+    int rc;
+    v4l2_format fmt;
 
-    if (fd < 0)
+    releaseBuffers();
+
+    format = requestedFormat;
+
+    memset(&fmt, 0, sizeof(v4l2_format));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    rc = ioctl(fd, VIDIOC_G_FMT, &fmt);
+    if (rc == 0)
     {
-        return;
+        setPixFormat(fmt);
+        rc = ioctl(fd, VIDIOC_S_FMT, &fmt);
     }
 
-    // Don't get more new frames until we run out of previous ones
-    if (!buffersDone.empty())
+    if (rc < 0)
     {
+        // Fall back to reopening the device with the new format
+        log<level::WARNING>("Failed to change video format while open",
+                            entry("FORMAT=%d", format),
+                            entry("ERROR=%s", strerror(errno)));
+        restart();
         return;
     }
 
-    FD_ZERO(&fds);
-    FD_SET(fd, &fds);
+    // The driver keeps its current format if it can't produce this one
+    pixelformat = fmt.fmt.pix.pixelformat;
+
+    allocBuffers();
+}
 
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
+void Video::adjustBuffers()
+{
+    releaseBuffers();
+    allocBuffers();
 
-    memset(&buf, 0, sizeof(v4l2_buffer));
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
+    log<level::INFO>("Changed video buffer ring depth",
+                     entry("COUNT=%u", bufferCount.load()),
+                     entry("REASON=%s", bufferReason.load()));
+}
 
-    // Switch to non-blocking in order to safely dequeue all buffers; if the
-    // video signal is lost while blocking to dequeue, the video driver may
-    // wait forever if signal is not re-acquired
-    fd_flags = fcntl(fd, F_GETFL);
-    fcntl(fd, F_SETFL, fd_flags | O_NONBLOCK);
+void Video::dqevents()
+{
+    int rc;
+    v4l2_event ev;
 
-    rc = select(fd + 1, &fds, NULL, NULL, &tv);
-    if (rc > 0)
+    do
     {
-        do
+        memset(&ev, 0, sizeof(v4l2_event));
+        rc = ioctl(fd, VIDIOC_DQEVENT, &ev);
+        if (rc >= 0 && ev.type == V4L2_EVENT_SOURCE_CHANGE &&
+            (ev.u.src_change.changes & V4L2_EVENT_SRC_CH_RESOLUTION))
         {
-            rc = ioctl(fd, VIDIOC_DQBUF, &buf);
-            if (rc >= 0)
-            {
-                buffers[buf.index].queued = false;
-
-                if (!(buf.flags & V4L2_BUF_FLAG_ERROR))
-                {
-                    buffers[buf.index].payload = buf.bytesused;
-                    buffers[buf.index].sequence = buf.sequence;
-                    if (format == 2)
-                    {
-                        rc = ioctl(fd, VIDIOC_G_SELECTION, &comp);
-                        if (rc)
-                        {
-                            log<level::ERR>("Failed to get selection box",
-                                            entry("ERROR=%s", strerror(errno)));
-                            comp.r.left = 0;
-                            comp.r.top = 0;
-                            comp.r.width = width;
-                            comp.r.height = height;
-                        }
-                        buffers[buf.index].box = comp.r;
-                    }
-                    buffersDone.push_back(buf.index);
-                }
-                else
-                {
-                    buffers[buf.index].payload = 0;
-                    qbuf(buf.index);
-                }
-            }
-        } while (rc >= 0);
-    }
-
-    fcntl(fd, F_SETFL, fd_flags);
+            sourceChanged = true;
+        }
+    } while (rc >= 0);
 }
 
 void Video::qbuf(int i)
 {
     int rc;
     v4l2_buffer buf;
+    std::lock_guard<std::mutex> guard(exportMutex);
+
+    // A leased buffer is queued by returnLeased() once the lease ended
+    if (i == leaseIndex)
+    {
+        leasedBuffers.push_back(i);
+        return;
+    }
+
+    if (i == exportIndex)
+    {
+        exportIndex = -1;
+    }
+
     if (!buffers[i].queued)
     {
         memset(&buf, 0, sizeof(v4l2_buffer));
@@ -174,6 +1156,10 @@ void Video::releaseFrames()
         buffersDone.pop_front();
         qbuf(i);
     }
+    else
+    {
+        placeholder = nullptr;
+    }
 }
 
 bool Video::needsResize()
@@ -191,6 +1177,22 @@ bool Video::needsResize()
         return true;
     }
 
+    // Drivers that report source changes only need the timings queried when
+    // an event arrives; the others are polled on every call
+    if (sourceEvents && !sourceChanged)
+    {
+        return false;
+    }
+
+    // Without a signal, don't reopen the device and wake the host on every
+    // loop; the timings are queried again once the backoff expires
+    if (signalState != SignalState::Signal && !reprobeDue())
+    {
+        return false;
+    }
+
+    sourceChanged = false;
+
     memset(&timings, 0, sizeof(v4l2_dv_timings));
     rc = ioctl(fd, VIDIOC_QUERY_DV_TIMINGS, &timings);
     if (rc < 0)
@@ -202,7 +1204,7 @@ bool Video::needsResize()
             timingsError = true;
         }
 
-        restart();
+        signalLost();
         return false;
     }
     else
@@ -210,6 +1212,13 @@ bool Video::needsResize()
         timingsError = false;
     }
 
+    if (signalState != SignalState::Signal)
+    {
+        log<level::INFO>("Video signal restored");
+        signalState = SignalState::Signal;
+        reprobeDelay = minReprobe;
+    }
+
     if (timings.bt.width != width || timings.bt.height != height)
     {
         width = timings.bt.width;
@@ -226,19 +1235,85 @@ bool Video::needsResize()
         }
 
         buffersDone.clear();
+        placeholder = nullptr;
         return true;
     }
 
     return false;
 }
 
+bool Video::reprobeDue()
+{
+    uint64_t powerOns = hostPowerOnCount;
+
+    // Power-on is when a signal is most likely to come back
+    if (powerOns != powerOnsSeen)
+    {
+        powerOnsSeen = powerOns;
+        reprobeDelay = minReprobe;
+        return true;
+    }
+
+    // A host known to be off only comes back with a power-on event
+    if (signalState == SignalState::PoweredOff &&
+        hostPowerState == HostPower::Off)
+    {
+        return false;
+    }
+
+    return std::chrono::steady_clock::now() >= nextProbe;
+}
+
+void Video::signalLost()
+{
+    uint32_t status = getSignalStatus();
+    SignalState state = SignalState::NoSignal;
+
+    if (hostPowerState == HostPower::Off ||
+        (status != UINT32_MAX && (status & V4L2_IN_ST_NO_POWER)))
+    {
+        state = SignalState::PoweredOff;
+    }
+
+    if (signalState == SignalState::Signal)
+    {
+        reprobeDelay = minReprobe;
+    }
+    else
+    {
+        reprobeDelay = std::min(reprobeDelay * 2, maxReprobe);
+    }
+
+    // A powered off host only comes back with a power-on event, so there
+    // is no point in probing it often
+    if (state == SignalState::PoweredOff)
+    {
+        reprobeDelay = maxReprobe;
+    }
+
+    if (state != signalState)
+    {
+        log<level::INFO>("Video signal lost",
+                         entry("STATE=%s", state == SignalState::PoweredOff
+                                               ? "powered off"
+                                               : "no signal"),
+                         entry("STATUS=0x%x", status));
+        signalState = state;
+    }
+
+    // Reopening the device and waking up a powered off host is pointless;
+    // the timings are queried on the open device until it powers on
+    if (state != SignalState::PoweredOff)
+    {
+        restart();
+    }
+
+    nextProbe = std::chrono::steady_clock::now() + reprobeDelay;
+}
+
 void Video::resize()
 {
     int rc;
-    unsigned int i;
-    bool needsResizeCall(false);
-    v4l2_buf_type type(V4L2_BUF_TYPE_VIDEO_CAPTURE);
-    v4l2_requestbuffers req;
 
     if (fd < 0)
     {
@@ -251,16 +1326,54 @@ void Video::resize()
         return;
     }
 
+    if (releaseBuffers())
+    {
+        v4l2_dv_timings timings;
+
+        memset(&timings, 0, sizeof(v4l2_dv_timings));
+        rc = ioctl(fd, VIDIOC_QUERY_DV_TIMINGS, &timings);
+        if (rc < 0)
+        {
+            log<level::ERR>("Failed to query timings, restart",
+                            entry("ERROR=%s", strerror(errno)));
+            restart();
+            return;
+        }
+
+        rc = ioctl(fd, VIDIOC_S_DV_TIMINGS, &timings);
+        if (rc < 0)
+        {
+            log<level::ERR>("Failed to set timings",
+                            entry("ERROR=%s", strerror(errno)));
+            elog<ReadFailure>(
+                xyz::openbmc_project::Common::Device::ReadFailure::
+                    CALLOUT_ERRNO(errno),
+                xyz::openbmc_project::Common::Device::ReadFailure::
+                    CALLOUT_DEVICE_PATH(path.c_str()));
+        }
+    }
+
+    allocBuffers();
+}
+
+bool Video::releaseBuffers()
+{
+    int rc;
+    unsigned int i;
+    bool mapped(false);
+    v4l2_buf_type type(V4L2_BUF_TYPE_VIDEO_CAPTURE);
+    v4l2_requestbuffers req;
+
     for (i = 0; i < buffers.size(); ++i)
     {
         if (buffers[i].data)
         {
-            needsResizeCall = true;
+            mapped = true;
             break;
         }
     }
 
-    if (needsResizeCall)
+    if (mapped)
     {
         rc = ioctl(fd, VIDIOC_STREAMOFF, &type);
         if (rc)
@@ -275,20 +1388,10 @@ void Video::resize()
         }
     }
 
-    for (i = 0; i < buffers.size(); ++i)
-    {
-        if (buffers[i].data)
-        {
-            munmap(buffers[i].data, buffers[i].size);
-            buffers[i].data = nullptr;
-            buffers[i].queued = false;
-        }
-    }
+    unmapBuffers();
 
-    if (needsResizeCall)
+    if (mapped)
     {
-        v4l2_dv_timings timings;
-
         memset(&req, 0, sizeof(v4l2_requestbuffers));
         req.count = 0;
         req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -305,33 +1408,51 @@ void Video::resize()
                     CALLOUT_DEVICE_PATH(path.c_str()));
         }
 
-        memset(&timings, 0, sizeof(v4l2_dv_timings));
-        rc = ioctl(fd, VIDIOC_QUERY_DV_TIMINGS, &timings);
-        if (rc < 0)
+        std::lock_guard<std::mutex> guard(exportMutex);
+
+        buffers.clear();
+    }
+
+    return mapped;
+}
+
+void Video::unmapBuffers()
+{
+    std::lock_guard<std::mutex> guard(exportMutex);
+
+    for (auto& buffer : buffers)
+    {
+        if (buffer.data)
         {
-            log<level::ERR>("Failed to query timings, restart",
-                            entry("ERROR=%s", strerror(errno)));
-            restart();
-            return;
+            munmap(buffer.data, buffer.size);
+            buffer.data = nullptr;
+            buffer.queued = false;
         }
 
-        rc = ioctl(fd, VIDIOC_S_DV_TIMINGS, &timings);
-        if (rc < 0)
+        if (buffer.dmabuf >= 0)
         {
-            log<level::ERR>("Failed to set timings",
-                            entry("ERROR=%s", strerror(errno)));
-            elog<ReadFailure>(
-                xyz::openbmc_project::Common::Device::ReadFailure::
-                    CALLOUT_ERRNO(errno),
-                xyz::openbmc_project::Common::Device::ReadFailure::
-                    CALLOUT_DEVICE_PATH(path.c_str()));
+            close(buffer.dmabuf);
+            buffer.dmabuf = -1;
         }
-
-        buffers.clear();
     }
 
+    exportIndex = -1;
+    exportGeneration++;
+    leaseIndex = -1;
+    leaseWanted = false;
+    leasedBuffers.clear();
+}
+
+void Video::allocBuffers()
+{
+    int rc;
+    unsigned int i;
+    v4l2_buf_type type(V4L2_BUF_TYPE_VIDEO_CAPTURE);
+    v4l2_requestbuffers req;
+    unsigned int count = requestedBuffers;
+
     memset(&req, 0, sizeof(v4l2_requestbuffers));
-    req.count = 3;
+    req.count = count;
     req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
     rc = ioctl(fd, VIDIOC_REQBUFS, &req);
@@ -346,11 +1467,22 @@ void Video::resize()
                 CALLOUT_DEVICE_PATH(path.c_str()));
     }
 
-    buffers.resize(req.count);
+    {
+        std::lock_guard<std::mutex> guard(exportMutex);
+
+        buffers.resize(req.count);
+        bufferCount = req.count;
+    }
+    lastSequence = -1;
+
+    // The driver may clamp the count; settle on what it gave us unless a
+    // new depth was requested in the meantime
+    requestedBuffers.compare_exchange_strong(count, req.count);
 
     for (i = 0; i < buffers.size(); ++i)
     {
         v4l2_buffer buf;
+        v4l2_exportbuffer expbuf;
 
         memset(&buf, 0, sizeof(v4l2_buffer));
         buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -384,6 +1516,23 @@ void Video::resize()
 
         buffers[i].size = buf.length;
 
+        memset(&expbuf, 0, sizeof(v4l2_exportbuffer));
+        expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        expbuf.index = i;
+        expbuf.flags = O_RDONLY | O_CLOEXEC;
+        rc = ioctl(fd, VIDIOC_EXPBUF, &expbuf);
+        if (rc < 0)
+        {
+            log<level::WARNING>("Failed to export buffer as dmabuf",
+                                entry("ERROR=%s", strerror(errno)));
+        }
+        else
+        {
+            std::lock_guard<std::mutex> guard(exportMutex);
+
+            buffers[i].dmabuf = expbuf.fd;
+        }
+
         rc = ioctl(fd, VIDIOC_QBUF, &buf);
         if (rc < 0)
         {
@@ -399,6 +1548,9 @@ void Video::resize()
         buffers[i].queued = true;
     }
 
+    // The engine starts every stream with a full screen
+    keyframe.reset(width, height);
+
     rc = ioctl(fd, VIDIOC_STREAMON, &type);
     if (rc)
     {
@@ -421,6 +1573,9 @@ void Video::start()
     v4l2_format fmt;
     v4l2_streamparm sparm;
     v4l2_control ctrl;
+    v4l2_queryctrl qctrl;
+    v4l2_event_subscription sub;
+    epoll_event event;
 
     if (fd >= 0)
     {
@@ -429,7 +1584,7 @@ void Video::start()
 
     input.sendWakeupPacket();
 
-    fd = open(path.c_str(), O_RDWR);
+    fd = open(path.c_str(), O_RDWR | O_NONBLOCK);
     if (fd < 0)
     {
         log<level::ERR>("Failed to open video device",
@@ -440,6 +1595,61 @@ void Video::start()
             xyz::openbmc_project::Common::File::Open::PATH(path.c_str()));
     }
 
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+    {
+        log<level::ERR>("Failed to create video epoll instance",
+                        entry("ERROR=%s", strerror(errno)));
+        elog<ReadFailure>(
+            xyz::openbmc_project::Common::Device::ReadFailure::CALLOUT_ERRNO(
+                errno),
+            xyz::openbmc_project::Common::Device::ReadFailure::
+                CALLOUT_DEVICE_PATH(path.c_str()));
+    }
+
+    memset(&sub, 0, sizeof(v4l2_event_subscription));
+    sub.type = V4L2_EVENT_SOURCE_CHANGE;
+    rc = ioctl(fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
+    if (rc < 0)
+    {
+        log<level::WARNING>(
+            "Failed to subscribe to source change events, polling timings",
+            entry("ERROR=%s", strerror(errno)));
+    }
+    sourceEvents = (rc >= 0);
+    sourceChanged = true;
+    lastFrameAt = std::chrono::steady_clock::now();
+
+    memset(&event, 0, sizeof(epoll_event));
+    event.events = EPOLLIN | EPOLLPRI | EPOLLET;
+    event.data.fd = fd;
+    rc = epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    if (rc < 0)
+    {
+        log<level::ERR>("Failed to register video device for polling",
+                        entry("ERROR=%s", strerror(errno)));
+        elog<ReadFailure>(
+            xyz::openbmc_project::Common::Device::ReadFailure::CALLOUT_ERRNO(
+                errno),
+            xyz::openbmc_project::Common::Device::ReadFailure::
+                CALLOUT_DEVICE_PATH(path.c_str()));
+    }
+
+    // Key and pointer events wake the capture up to restore the full frame
+    // rate while it is lowered for an idle screen
+    if (input.getActivityFd() >= 0)
+    {
+        memset(&event, 0, sizeof(epoll_event));
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = input.getActivityFd();
+        rc = epoll_ctl(epollFd, EPOLL_CTL_ADD, input.getActivityFd(), &event);
+        if (rc < 0)
+        {
+            log<level::WARNING>("Failed to register input activity for polling",
+                                entry("ERROR=%s", strerror(errno)));
+        }
+    }
+
     memset(&cap, 0, sizeof(v4l2_capability));
     rc = ioctl(fd, VIDIOC_QUERYCAP, &cap);
     if (rc < 0)
@@ -476,15 +1686,7 @@ void Video::start()
                 CALLOUT_DEVICE_PATH(path.c_str()));
     }
 
-    switch (format)
-    {
-        case 2:
-            fmt.fmt.pix.flags = V4L2_PIX_FMT_FLAG_PARTIAL_JPG;
-        default:
-        case 0:
-            fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_JPEG;
-            break;
-    }
+    setPixFormat(fmt);
     rc = ioctl(fd, VIDIOC_S_FMT, &fmt);
     if (rc < 0)
     {
@@ -507,6 +1709,17 @@ void Video::start()
         log<level::WARNING>("Failed to set video device frame rate",
                             entry("ERROR=%s", strerror(errno)));
     }
+    captureRate = frameRate;
+    requestedRate = frameRate;
+    governor.reset();
+
+    subSampling = requestedSubsampling.load();
+    lastPayload = 0;
+    chromaPolicy.reset();
+
+    // A new stream starts from a full screen
+    captureMode = -1;
+    fullFrameRequested = true;
 
     ctrl.id = V4L2_CID_JPEG_CHROMA_SUBSAMPLING;
     ctrl.value = subSampling ? V4L2_JPEG_CHROMA_SUBSAMPLING_420
@@ -518,11 +1731,45 @@ void Video::start()
                             entry("ERROR=%s", strerror(errno)));
     }
 
+    regionsSupported = probeRegions();
+
+    memset(&qctrl, 0, sizeof(v4l2_queryctrl));
+    qctrl.id = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+    rc = ioctl(fd, VIDIOC_QUERYCTRL, &qctrl);
+    if (rc < 0 || (qctrl.flags & V4L2_CTRL_FLAG_DISABLED))
+    {
+        log<level::WARNING>("Video jpeg quality is not adjustable");
+        quality = -1;
+    }
+    else
+    {
+        qualityMin = qctrl.minimum;
+        qualityMax = qctrl.maximum;
+        quality = qctrl.default_value;
+
+        ctrl.id = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+        rc = ioctl(fd, VIDIOC_G_CTRL, &ctrl);
+        if (rc == 0)
+        {
+            quality = ctrl.value;
+        }
+
+        if (requestedQuality < 0)
+        {
+            requestedQuality = quality.load();
+        }
+        else if (requestedQuality != quality)
+        {
+            adjustQuality();
+        }
+    }
+
     height = fmt.fmt.pix.height;
     width = fmt.fmt.pix.width;
     pixelformat = fmt.fmt.pix.pixelformat;
 
-    if (pixelformat != V4L2_PIX_FMT_RGB24 && pixelformat != V4L2_PIX_FMT_JPEG)
+    if (pixelformat != V4L2_PIX_FMT_RGB24 && pixelformat != V4L2_PIX_FMT_JPEG &&
+        pixelformat != V4L2_PIX_FMT_AJPG && pixelformat != V4L2_PIX_FMT_HEXTILE)
     {
         log<level::ERR>("Pixel Format not supported",
                         entry("PIXELFORMAT=%d", pixelformat));
@@ -539,7 +1786,6 @@ void Video::start()
 void Video::stop()
 {
     int rc;
-    unsigned int i;
     v4l2_buf_type type(V4L2_BUF_TYPE_VIDEO_CAPTURE);
 
     if (fd < 0)
@@ -548,6 +1794,7 @@ void Video::stop()
     }
 
     buffersDone.clear();
+    placeholder = nullptr;
 
     rc = ioctl(fd, VIDIOC_STREAMOFF, &type);
     if (rc)
@@ -556,14 +1803,12 @@ void Video::stop()
                         entry("ERROR=%s", strerror(errno)));
     }
 
-    for (i = 0; i < buffers.size(); ++i)
+    unmapBuffers();
+
+    if (epollFd >= 0)
     {
-        if (buffers[i].data)
-        {
-            munmap(buffers[i].data, buffers[i].size);
-            buffers[i].data = nullptr;
-            buffers[i].queued = false;
-        }
+        close(epollFd);
+        epollFd = -1;
     }
 
     close(fd);
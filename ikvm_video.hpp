@@ -1,11 +1,23 @@
 #pragma once
 
+#include "ami/include/ikvm_placeholder.hpp"
 #include "ami/include/ikvm_utils.hpp"
+#include "ikvm_chroma_policy.hpp"
+#include "ikvm_flight_recorder.hpp"
+#include "ikvm_frame_governor.hpp"
+#include "ikvm_frame_log.hpp"
 #include "ikvm_input.hpp"
+#include "ikvm_keyframe.hpp"
+#include "ikvm_rate_control.hpp"
+#include "ikvm_video_source.hpp"
 
 #include <linux/videodev2.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -16,19 +28,83 @@ namespace ikvm
  * @class Video
  * @brief Sets up the V4L2 video device and performs read operations
  */
-class Video
+class Video : public VideoSource
 {
   public:
+    /*
+     * @struct ExportedFrame
+     * @brief Describes a captured frame handed out as a dmabuf
+     */
+    struct ExportedFrame
+    {
+        /* @brief Index of the streaming buffer holding the frame */
+        unsigned int index;
+        /* @brief Incremented whenever the streaming buffers are re-allocated */
+        uint32_t generation;
+        /* @brief Size of the streaming buffer in bytes */
+        size_t size;
+        /* @brief Number of bytes of frame data in the buffer */
+        size_t payload;
+        /* @brief Driver sequence number of the frame */
+        uint32_t sequence;
+        /* @brief Bounding-box of a partial-jpeg frame */
+        v4l2_rect box;
+        /* @brief Width in pixels of the video frame */
+        size_t width;
+        /* @brief Height in pixels of the video frame */
+        size_t height;
+        /* @brief V4L2 pixel format of the frame data */
+        uint32_t pixelformat;
+        /* @brief jpeg format, 0:standard jpeg, 2:partial jpeg */
+        int format;
+    };
+
+    /*
+     * @enum SignalState
+     * @brief State of the host video signal
+     */
+    enum class SignalState
+    {
+        Signal,
+        NoSignal,
+        PoweredOff
+    };
+
+    /*
+     * @struct Counters
+     * @brief Frame drop and error counts since the daemon started
+     */
+    struct Counters
+    {
+        /* @brief Frames the driver dropped, from sequence number gaps */
+        uint64_t dropped;
+        /* @brief Buffers the driver flagged with an error */
+        uint64_t errors;
+        /* @brief Frames not sent because the jpeg end marker is missing */
+        uint64_t truncated;
+        /* @brief Frames not sent because their CRC matched the last one */
+        uint64_t unchanged;
+    };
+
     /*
      * @brief Constructs Video object
      *
-     * @param[in] p     - Path to the V4L2 video device
-     * @param[in] input - Reference to the Input object
-     * @param[in] fr    - desired frame rate of the video
+     * @param[in] p         - Path to the V4L2 video device
+     * @param[in] input     - Reference to the Input object
+     * @param[in] fr        - desired frame rate of the video
+     * @param[in] sub       - desired jpeg subsampling, 2 to adapt it to the
+     *                        screen activity
+     * @param[in] fmt       - desired jpeg capture format
+     * @param[in] bufs      - desired number of streaming buffers
+     * @param[in] adaptBufs - adapt the number of buffers to frame drops
+     * @param[in] q         - initial jpeg quality, -1 for the driver default
+     * @param[in] kbps      - target bitrate of the stream, 0 to disable
+     * @param[in] adaptRate - lower the capture rate while the screen is idle
      */
     Video(const std::string& p, Input& input, int fr = 30, int sub = 0,
-          int fmt = 0);
-    ~Video();
+          int fmt = 0, unsigned int bufs = 3, bool adaptBufs = false,
+          int q = -1, uint32_t kbps = 0, bool adaptRate = false);
+    ~Video() override;
     Video(const Video&) = default;
     Video& operator=(const Video&) = default;
     Video(Video&&) = default;
@@ -43,37 +119,277 @@ class Video
     char* getData(unsigned int i);
 
     /* @brief Performs read to grab latest video frame */
-    void getFrame();
+    void getFrame() override;
     /* @brief Performs return done video frames back to driver */
-    void releaseFrames();
+    void releaseFrames() override;
+    /*
+     * @brief Describes the oldest captured frame not yet released
+     *
+     * @param[out] frame - Descriptor of the frame
+     *
+     * @return Boolean indicating if there is a frame to send
+     */
+    bool getCurrentFrame(Frame& frame) const override;
+    /*
+     * @brief Leases the most recently captured frame out as a dmabuf. The
+     *        buffer stays off the driver queue until releaseExport() is
+     *        called, the lease times out or the next frame is leased, so
+     *        its contents are stable meanwhile. Once the newest frame is
+     *        back with the driver, the next captured one is kept instead.
+     *
+     * @param[out] frame - Metadata of the exported frame
+     *
+     * @return Duplicated dmabuf file descriptor owned by the caller,
+     *         -EAGAIN if the next captured frame is kept for the caller,
+     *         -EBUSY if the ring is too shallow to lend a buffer out or
+     *         -ENODATA if frames cannot be exported
+     */
+    int exportFrame(ExportedFrame& frame);
+    /*
+     * @brief Ends the lease of an exported frame
+     *
+     * @param[in] index      - Buffer index of the exported frame
+     * @param[in] generation - Buffer generation of the exported frame
+     */
+    void releaseExport(unsigned int index, uint32_t generation);
+    /*
+     * @brief Feeds the rate controller after the current frame was sent
+     *
+     * @param[in] backlog - Largest number of bytes still queued to a client
+     */
+    void frameSent(size_t backlog) override;
+    /*
+     * @brief Tells the frame rate governor the current frame was skipped
+     *        because it is identical to the previous one
+     */
+    void frameUnchanged() override;
+    /*
+     * @brief Accounts the current frame as skipped because its jpeg data is
+     *        truncated
+     */
+    inline void frameTruncated() override
+    {
+        truncatedFrames++;
+    }
+    /*
+     * @brief Asks the NPCM engine to capture the whole screen once instead
+     *        of the changed rectangles only
+     */
+    inline void requestFullFrame() override
+    {
+        fullFrameRequested = true;
+    }
+    /* @brief Partial-jpeg frames are composited into a keyframe */
+    inline bool hasKeyframe() override
+    {
+        return format == 2 && keyframe.ready();
+    }
+    inline bool getKeyframe(std::vector<char>& jpeg, Updates& updates) override
+    {
+        return format == 2 && keyframe.get(jpeg, updates);
+    }
+    /*
+     * @brief Gets the frame drop and error counts
+     *
+     * @return Snapshot of the counters
+     */
+    Counters getCounters() const;
+    /*
+     * @brief Records every captured jpeg frame to a frame log. Recording
+     *        never stalls capture; frames are dropped when the log falls
+     *        behind.
+     *
+     * @param[in] logPath - Path to the frame log, empty to stop recording
+     */
+    void record(const std::string& logPath);
+    /*
+     * @brief Keeps the most recent jpeg frames in memory to be saved when
+     *        the host crashes
+     *
+     * @param[in] window - Capture time span of the kept frames, 0 to stop
+     * @param[in] bytes  - Most bytes of frame data kept
+     */
+    void keepFrames(std::chrono::seconds window, size_t bytes);
+    /*
+     * @brief Saves the kept frames as a frame log and starts keeping anew
+     *
+     * @param[in] path - Path to the frame log
+     */
+    void saveRecentFrames(const std::string& path) override;
+    inline bool keepsFrames() const override
+    {
+        return flightRecorder != nullptr;
+    }
+    void setUnattended(bool idle) override;
+    inline void hashFrames(bool enable) override
+    {
+        hashing = enable;
+    }
     /*
      * @brief Gets whether or not the video frame needs to be resized
      *
      * @return Boolean indicating if the frame needs to be resized
      */
-    bool needsResize();
+    bool needsResize() override;
     /* @brief Performs the resize and re-allocates framebuffer */
-    void resize();
+    void resize() override;
     /* @brief Starts streaming from the video device */
-    void start();
+    void start() override;
     /* @brief Stops streaming from the video device */
-    void stop();
+    void stop() override;
     /* @brief Restarts streaming from the video device */
     void restart()
     {
         stop();
         start();
     }
+    /*
+     * @brief Bounds the wait for a frame in one getFrame call, so that a
+     *        capture loop shared by several device sets moves on to the
+     *        others; the signal still counts as lost after frameTimeout
+     *
+     * @param[in] ms - Milliseconds to wait at most
+     */
+    inline void setFrameWait(int ms)
+    {
+        frameWait = std::clamp(ms, 1, frameTimeout);
+    }
 
     /*
      * @brief Gets the desired video frame rate in frames per second
      *
      * @return Value of the desired frame rate
      */
-    inline int getFrameRate() const
+    inline int getFrameRate() const override
     {
         return frameRate;
     }
+    /*
+     * @brief Gets the frame rate the device currently captures at
+     *
+     * @return Capture frame rate, lower than the desired one while idle
+     */
+    inline int getCaptureRate() const
+    {
+        return captureRate;
+    }
+    /*
+     * @brief Gets whether the capture rate is lowered while the screen is
+     *        idle
+     *
+     * @return Boolean indicating if the frame rate governor is enabled
+     */
+    inline bool getAdaptiveFrameRate() const
+    {
+        return adaptiveRate;
+    }
+    /*
+     * @brief Enables or disables the frame rate governor
+     *
+     * @param[in] adapt - Boolean to enable the frame rate governor
+     */
+    inline void setAdaptiveFrameRate(bool adapt)
+    {
+        adaptiveRate = adapt;
+    }
+    /*
+     * @brief Gets the number of streaming buffers allocated by the driver
+     *
+     * @return Depth of the capture buffer ring
+     */
+    inline unsigned int getBufferCount() const
+    {
+        return bufferCount;
+    }
+    /*
+     * @brief Requests a new number of streaming buffers, applied between
+     *        frames. In adaptive mode this is the depth shrunk back to.
+     *
+     * @param[in] count - desired depth of the capture buffer ring
+     */
+    void setBufferCount(unsigned int count);
+    /*
+     * @brief Gets the number of streaming buffers to allocate next
+     *
+     * @return Requested depth of the capture buffer ring
+     */
+    inline unsigned int getRequestedBufferCount() const
+    {
+        return requestedBuffers;
+    }
+    /*
+     * @brief Gets why the buffer ring depth was last changed
+     *
+     * @return Reason for the current buffer ring depth
+     */
+    inline std::string getBufferReason() const
+    {
+        return bufferReason.load();
+    }
+    /*
+     * @brief Gets whether the buffer ring depth adapts to frame drops
+     *
+     * @return Boolean indicating if adaptive buffering is enabled
+     */
+    inline bool getAdaptiveBuffers() const
+    {
+        return adaptiveBuffers;
+    }
+    /*
+     * @brief Enables or disables adapting the buffer ring depth
+     *
+     * @param[in] adapt - Boolean to enable adaptive buffering
+     */
+    inline void setAdaptiveBuffers(bool adapt)
+    {
+        adaptiveBuffers = adapt;
+    }
+    /*
+     * @brief Gets the current hardware jpeg quality
+     *
+     * @return Value of the jpeg quality, -1 if not adjustable
+     */
+    inline int getQuality() const
+    {
+        return quality;
+    }
+    /*
+     * @brief Sets the hardware jpeg quality, applied between frames. With a
+     *        target bitrate the rate controller moves on from this value.
+     *
+     * @param[in] q - desired jpeg quality
+     */
+    inline void setQuality(int q)
+    {
+        requestedQuality = q;
+    }
+    /*
+     * @brief Gets the hardware jpeg quality to apply next
+     *
+     * @return Value of the requested jpeg quality
+     */
+    inline int getRequestedQuality() const
+    {
+        return requestedQuality;
+    }
+    /*
+     * @brief Gets the target bitrate of the stream
+     *
+     * @return Target bitrate in kilobits per second, 0 if disabled
+     */
+    inline uint32_t getTargetBitrate() const
+    {
+        return rateControl.getTarget();
+    }
+    /*
+     * @brief Sets the target bitrate the jpeg quality is steered towards
+     *
+     * @param[in] kbps - Target bitrate in kilobits per second, 0 to disable
+     */
+    inline void setTargetBitrate(uint32_t kbps)
+    {
+        rateControl.setTarget(kbps);
+    }
     /*
      * @brief Gets the size of the video frame data
      *
@@ -109,7 +425,7 @@ class Video
      *
      * @return Value of the height of video frame in pixels
      */
-    inline size_t getHeight() const
+    inline size_t getHeight() const override
     {
         return height;
     }
@@ -117,7 +433,7 @@ class Video
      * @brief Gets the pixel format  of the video frame
      *
      * @return Value of the pixel format of video frame */
-    inline uint32_t getPixelformat() const
+    inline uint32_t getPixelformat() const override
     {
         return pixelformat;
     }
@@ -126,7 +442,7 @@ class Video
      *
      * @return Value of the width of video frame in pixels
      */
-    inline size_t getWidth() const
+    inline size_t getWidth() const override
     {
         return width;
     }
@@ -140,13 +456,41 @@ class Video
         return subSampling;
     }
     /*
-     * @brief Sets the subsampling of the video frame
+     * @brief Sets the subsampling of the video frame, applied between frames.
+     *        In adaptive mode the policy moves on from this value.
      *
-     * @return Value of the subsampling of video frame, 1:420/0:444
+     * @param[in] _sub - desired subsampling of video frame, 1:420/0:444
      */
     inline void setSubsampling(int _sub)
     {
-        subSampling = _sub;
+        requestedSubsampling = _sub ? 1 : 0;
+    }
+    /*
+     * @brief Gets the subsampling to apply next
+     *
+     * @return Value of the requested subsampling, 1:420/0:444
+     */
+    inline int getRequestedSubsampling() const
+    {
+        return requestedSubsampling;
+    }
+    /*
+     * @brief Gets whether the subsampling adapts to the screen activity
+     *
+     * @return Boolean indicating if adaptive subsampling is enabled
+     */
+    inline bool getAdaptiveSubsampling() const
+    {
+        return adaptiveSubsampling;
+    }
+    /*
+     * @brief Enables or disables adapting the subsampling
+     *
+     * @param[in] adapt - Boolean to enable adaptive subsampling
+     */
+    inline void setAdaptiveSubsampling(bool adapt)
+    {
+        adaptiveSubsampling = adapt;
     }
     /*
      * @brief Gets the jpeg format of the video frame
@@ -154,7 +498,7 @@ class Video
      * @return Value of the jpeg format of video frame
      *         0:standard jpeg, 1:reserved, 2:partial jpeg
      */
-    inline int getFormat() const
+    inline int getFormat() const override
     {
         return format;
     }
@@ -167,6 +511,7 @@ class Video
     inline void setFormat(int _fmt)
     {
         format = _fmt;
+        requestedFormat = _fmt;
     }
     /*
      * @brief gets the jpeg format of the video frame
@@ -175,7 +520,7 @@ class Video
      * @return Value of the jpeg format of video frame
      *         0:standard jpeg, 1:reserved, 2:Partial jpeg
      */
-    inline int getOriginalFormat() const
+    inline int getOriginalFormat() const override
     {
         return originalFormat;
     }
@@ -189,12 +534,10 @@ class Video
         return buffers[i].box;
     }
 
-    /* @brief Number of bits per component of a pixel */
-    static const int bitsPerSample;
-    /* @brief Number of bytes of storage for a pixel */
-    static const int bytesPerPixel;
-    /* @brief Number of components in a pixel (i.e. 3 for RGB pixel) */
-    static const int samplesPerPixel;
+    /* @brief Smallest number of streaming buffers */
+    static constexpr unsigned int minBuffers = 2;
+    /* @brief Largest number of streaming buffers */
+    static constexpr unsigned int maxBuffers = 8;
     /* @brief done buffer storage */
     std::deque<int> buffersDone;
     /*
@@ -208,16 +551,116 @@ class Video
      * @return Host video Signal status
      */
     uint32_t getSignalStatus();
-    /* @brief Performs the video frame jpeg-capture format change operation*/
-    void formatChange(int newformat);
     /*
-     * @brief captures video frame and
-     * stores as an image(.jpeg) in BMC local memory(screenShotPath).
-     * @param[in] screenShotPath : path to store Image
+     * @brief Gets the state of the host video signal
+     *
+     * @return Whether there is a signal, no signal or the host is off
+     */
+    inline SignalState getSignalState() const
+    {
+        return signalState;
+    }
+    /*
+     * @brief Performs the video frame jpeg-capture format change operation.
+     *        While streaming, the change is applied between frames without
+     *        reopening the device.
+     */
+    void formatChange(int newformat) override;
+    /*
+     * @brief Copies the current frame, the composite of the partial-jpeg
+     *        frames or the placeholder of a missing signal as an image
+     *
+     * @param[out] image - jpeg data of the image
+     *
+     * @return Boolean indicating if an image was taken
      */
-    void screenShot(const std::string& screenShotPath);
+    bool screenShot(std::vector<char>& image) override;
 
   private:
+    /*
+     * @brief Milliseconds to wait for the driver to complete a frame before
+     *        giving up; only reached when the video signal is lost
+     */
+    static constexpr int frameTimeout = 1000;
+    /* @brief Seconds of frames over which buffer starvation is evaluated */
+    static constexpr int adaptWindowSeconds = 4;
+    /* @brief Starvations or dropped frames per window to grow the ring */
+    static constexpr unsigned int adaptThreshold = 2;
+    /* @brief Windows without starvation or drops before shrinking the ring */
+    static constexpr unsigned int adaptQuietWindows = 8;
+    /* @brief First delay before reprobing a lost video signal */
+    static constexpr std::chrono::milliseconds minReprobe{500};
+    /* @brief Longest delay between reprobes of a lost video signal */
+    static constexpr std::chrono::milliseconds maxReprobe{32000};
+    /* @brief Delay between placeholder frames while there is no signal */
+    static constexpr std::chrono::seconds placeholderInterval{2};
+    /* @brief Longest time a buffer stays leased out as a dmabuf */
+    static constexpr std::chrono::seconds leaseTimeout{1};
+    /* @brief Frames per second captured while nobody watches them */
+    static constexpr int unattendedRate = 2;
+
+    /* @brief Dequeues pending V4L2 events and flags source changes */
+    void dqevents();
+    /*
+     * @brief Gets whether a lost video signal is due to be reprobed
+     *
+     * @return Boolean indicating if the timings should be queried
+     */
+    bool reprobeDue();
+    /* @brief Reopens the device unless the host is powered off, and backs
+     *        off after a failed probe */
+    void signalLost();
+    /*
+     * @brief Publishes the NO SIGNAL or POWER OFF image as the current frame
+     *        when the next one is due
+     */
+    void placeholderFrame();
+    /*
+     * @brief Stops streaming and frees the streaming buffers
+     *
+     * @return Boolean indicating if any buffers were mapped
+     */
+    bool releaseBuffers();
+    /* @brief Unmaps the streaming buffers and closes their dmabufs */
+    void unmapBuffers();
+    /* @brief Queues the buffers held back for an ended dmabuf lease */
+    void returnLeased();
+    /* @brief Requests, maps and queues the streaming buffers and streams */
+    void allocBuffers();
+    /*
+     * @brief Sets the pixel format and flags for the current jpeg format
+     *
+     * @param[in,out] fmt - Format queried from the driver
+     */
+    void setPixFormat(v4l2_format& fmt) const;
+    /* @brief Switches the capture format without reopening the device */
+    void adjustFormat();
+    /* @brief Applies the requested jpeg quality between frames */
+    void adjustQuality();
+    /* @brief Applies the requested jpeg subsampling between frames */
+    void adjustSubsampling();
+    /* @brief Applies the capture frame rate picked by the governor */
+    void adjustFrameRate();
+    /* @brief Switches the NPCM engine between full and changed captures */
+    void adjustCaptureMode();
+    /*
+     * @brief Feeds the frame rate governor with the current frame
+     *
+     * @param[in] unchanged - Whether the frame is the same as the last one
+     */
+    void governFrame(bool unchanged);
+    /* @brief Restores the full capture rate after input activity */
+    void wakeFrameRate();
+    /*
+     * @brief Measures how much of the screen the current frame changed
+     *
+     * @return Changed part of the screen in 1/1000ths
+     */
+    unsigned int frameChange();
+    /* @brief Re-allocates the streaming buffers with the requested depth */
+    void adjustBuffers();
+    /* @brief Grows or shrinks the buffer ring from the window statistics */
+    void adaptBuffers();
     void qbuf(int i);
     /*
      * @struct Buffer
@@ -226,7 +669,10 @@ class Video
      */
     struct Buffer
     {
-        Buffer() : data(nullptr), queued(false), payload(0), size(0) {}
+        Buffer() :
+            data(nullptr), queued(false), payload(0), size(0), rects(0),
+            regionCount(0), jpeg{}, crc(-1), dmabuf(-1)
+        {}
         ~Buffer() = default;
         Buffer(const Buffer&) = default;
         Buffer& operator=(const Buffer&) = default;
@@ -239,8 +685,44 @@ class Video
         size_t size;
         uint32_t sequence;
         v4l2_rect box;
+        unsigned int rects;
+        std::array<Region, maxRegions> regions;
+        unsigned int regionCount;
+        JpegInfo jpeg;
+        int64_t crc;
+        std::chrono::steady_clock::time_point timestamp;
+        int dmabuf;
     };
 
+    /*
+     * @brief Reads the changed regions of a partial-jpeg frame, or only its
+     *        bounding-box from the selection when the driver has no list
+     *
+     * @param[in,out] buffer - Buffer holding the frame
+     */
+    void getRegions(Buffer& buffer);
+    /*
+     * @brief Checks that the driver has the partial-jpeg regions control
+     *        laid out as VideoSource::Region
+     *
+     * @return Boolean indicating if the regions can be read
+     */
+    bool probeRegions();
+    /*
+     * @brief Describes the jpeg of a frame, or every jpeg of a frame with
+     *        changed regions
+     *
+     * @param[in,out] buffer - Buffer holding the frame
+     */
+    void describeJpeg(Buffer& buffer);
+
+    /*
+     * @brief Hands a captured frame to the frame log and flight recorders
+     *
+     * @param[in] buffer - Buffer holding the frame
+     */
+    void recordFrame(const Buffer& buffer);
+
     /*
      * @brief Boolean to indicate whether the resize was triggered during
      *        the open operation
@@ -248,10 +730,38 @@ class Video
     bool resizeAfterOpen;
     /* @brief Indicates whether or not timings query was last sucessful */
     bool timingsError;
+    /* @brief Indicates whether the driver reports source change events */
+    bool sourceEvents;
+    /* @brief Indicates whether the timings need to be queried again */
+    bool sourceChanged;
+    /* @brief State of the host video signal */
+    std::atomic<SignalState> signalState;
+    /* @brief Delay before the next reprobe of a lost video signal */
+    std::chrono::milliseconds reprobeDelay;
+    /* @brief Time the lost video signal is reprobed */
+    std::chrono::steady_clock::time_point nextProbe;
+    /* @brief Host power-on count the signal was last reprobed for */
+    uint64_t powerOnsSeen;
     /* @brief File descriptor for the V4L2 video device */
     int fd;
+    /* @brief Epoll instance the non-blocking video device is registered in */
+    int epollFd;
+    /* @brief Milliseconds to wait for a frame in one getFrame call */
+    int frameWait;
+    /* @brief Time the last frame was dequeued, or the device opened */
+    std::chrono::steady_clock::time_point lastFrameAt;
     /* @brief Desired frame rate of video stream in frames per second */
     int frameRate;
+    /* @brief Frame rate the device captures at in frames per second */
+    std::atomic<int> captureRate;
+    /* @brief Capture frame rate picked by the governor */
+    int requestedRate;
+    /* @brief Lower the capture rate while the screen is idle */
+    std::atomic<bool> adaptiveRate;
+    /* @brief Frames are only kept for a host crash, at unattendedRate */
+    bool unattended;
+    /* @brief Picks the capture rate from the screen and input activity */
+    FrameGovernor governor;
     /* @brief Buffer index for the last video frame */
     int lastFrameIndex;
     /* @brief Height in pixels of the video frame */
@@ -259,17 +769,106 @@ class Video
     /* @brief Width in pixels of the video frame */
     size_t width;
     /* @brief jpeg's subsampling, 1:420/0:444 */
-    int subSampling;
+    std::atomic<int> subSampling;
+    /* @brief jpeg subsampling to apply between frames */
+    std::atomic<int> requestedSubsampling;
+    /* @brief Adapt the jpeg subsampling to the screen activity */
+    std::atomic<bool> adaptiveSubsampling;
+    /* @brief NPCM capture mode, -1 until set */
+    int captureMode;
+    /* @brief Capture the whole screen with the next NPCM frame */
+    std::atomic<bool> fullFrameRequested;
+    /* @brief The driver lists the changed regions of partial-jpeg frames */
+    bool regionsSupported;
+    /* @brief Full screen composite of the partial-jpeg frames */
+    KeyframeCache keyframe;
+    /* @brief Payload of the last sent full frame, to spot unchanged ones */
+    size_t lastPayload;
     /* @brief Reference to the Input object */
     Input& input;
     /* @brief jpeg format */
     int format;
     /* @brief jpeg fomat set by openBMC ikvm Daemon*/
     int originalFormat;
+    /* @brief jpeg format to switch to between frames */
+    int requestedFormat;
     /* @brief Path to the V4L2 video device */
     const std::string path;
     /* @brief Streaming buffer storage */
     std::vector<Buffer> buffers;
+    /* @brief Buffer ring depth that adaptive mode shrinks back to */
+    std::atomic<unsigned int> baseBuffers;
+    /* @brief Buffer ring depth to apply between frames */
+    std::atomic<unsigned int> requestedBuffers;
+    /* @brief Buffer ring depth allocated by the driver */
+    std::atomic<unsigned int> bufferCount;
+    /* @brief Adapt the buffer ring depth to starvation and frame drops */
+    std::atomic<bool> adaptiveBuffers;
+    /* @brief Why the buffer ring depth was last changed */
+    std::atomic<const char*> bufferReason;
+    /* @brief Sequence number of the last dequeued buffer */
+    int64_t lastSequence;
+    /* @brief Frames dequeued in the current adaptive window */
+    unsigned int windowFrames;
+    /* @brief Frames dropped by the driver in the current adaptive window */
+    unsigned int windowGaps;
+    /* @brief Dequeues that left the driver without a buffer this window */
+    unsigned int windowStarved;
+    /* @brief Consecutive windows without starvation or dropped frames */
+    unsigned int quietWindows;
+    /* @brief Frames dropped by the driver since the daemon started */
+    std::atomic<uint64_t> droppedFrames;
+    /* @brief Error-flagged buffers since the daemon started */
+    std::atomic<uint64_t> errorFrames;
+    /* @brief Truncated jpeg frames since the daemon started */
+    std::atomic<uint64_t> truncatedFrames;
+    /* @brief Frames skipped by the CRC check since the daemon started */
+    std::atomic<uint64_t> unchangedFrames;
+    /* @brief Buffer index of the most recent frame while it is off the
+     *        driver queue, -1 otherwise */
+    int exportIndex;
+    /* @brief Generation of the streaming buffers for dmabuf export */
+    uint32_t exportGeneration;
+    /* @brief Buffer index leased out as a dmabuf, -1 if none */
+    int leaseIndex;
+    /* @brief The next captured frame is to be leased out */
+    bool leaseWanted;
+    /* @brief End of the current dmabuf lease */
+    std::chrono::steady_clock::time_point leaseExpiry;
+    /* @brief Buffers kept off the driver queue for a dmabuf lease */
+    std::vector<int> leasedBuffers;
+    /* @brief Mutex guarding the exported buffers and the dmabuf lease */
+    std::mutex exportMutex;
+    /* @brief Hardware jpeg quality, -1 if not adjustable */
+    std::atomic<int> quality;
+    /* @brief Hardware jpeg quality to apply between frames */
+    std::atomic<int> requestedQuality;
+    /* @brief Lowest hardware jpeg quality */
+    int qualityMin;
+    /* @brief Highest hardware jpeg quality */
+    int qualityMax;
+    /* @brief Steers the jpeg quality towards the target bitrate */
+    RateControl rateControl;
+    /* @brief Picks the jpeg subsampling from the screen activity */
+    ChromaPolicy chromaPolicy;
+    /* @brief Appends the captured frames to a frame log */
+    std::unique_ptr<FrameLogWriter> recorder;
+    /* @brief Keeps the most recent frames for a crash */
+    std::unique_ptr<FlightRecorder> flightRecorder;
+    /* @brief Hashes every captured frame */
+    bool hashing;
+    /* @brief Image sent while the host has no video signal */
+    Placeholder noSignalImage;
+    /* @brief Image sent while the host is powered off */
+    Placeholder powerOffImage;
+    /* @brief Placeholder published as the current frame, if any */
+    const std::vector<char>* placeholder;
+    /* @brief Layout of the placeholder jpeg */
+    JpegInfo placeholderJpeg;
+    /* @brief CRC-32 of the placeholder, -1 when frames are not hashed */
+    int64_t placeholderCrc;
+    /* @brief Time the next placeholder frame is due */
+    std::chrono::steady_clock::time_point nextPlaceholder;
 
     /* @brief Pixel Format  */
     uint32_t pixelformat;
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "ikvm_jpeg.hpp"
+
+#include <linux/videodev2.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* ASPEED video engine proprietary compression, from linux/videodev2.h */
+#ifndef V4L2_PIX_FMT_AJPG
+#define V4L2_PIX_FMT_AJPG v4l2_fourcc('A', 'J', 'P', 'G')
+#endif
+
+/* Nuvoton NPCM video engine, from linux/npcm-video.h */
+#ifndef V4L2_PIX_FMT_HEXTILE
+#define V4L2_PIX_FMT_HEXTILE v4l2_fourcc('H', 'X', 'T', 'L')
+#endif
+#ifndef V4L2_CID_USER_NPCM_BASE
+#define V4L2_CID_USER_NPCM_BASE (V4L2_CID_USER_BASE + 0x11b0)
+#endif
+#ifndef V4L2_CID_NPCM_CAPTURE_MODE
+#define V4L2_CID_NPCM_CAPTURE_MODE (V4L2_CID_USER_NPCM_BASE + 0)
+#define V4L2_NPCM_CAPTURE_MODE_COMPLETE 0
+#define V4L2_NPCM_CAPTURE_MODE_DIFF 1
+#endif
+#ifndef V4L2_CID_NPCM_RECT_COUNT
+#define V4L2_CID_NPCM_RECT_COUNT (V4L2_CID_USER_NPCM_BASE + 1)
+#endif
+
+/*
+ * ASPEED video engine partial-jpeg regions: a dynamic array control of
+ * VideoSource::Region, one jpeg per changed area of the frame. Only a
+ * patched driver has it, so it is read with the aspeed-jpeg-regions build
+ * option alone and probed before use.
+ */
+#ifndef V4L2_CID_USER_ASPEED_BASE
+#define V4L2_CID_USER_ASPEED_BASE (V4L2_CID_USER_BASE + 0x11a0)
+#endif
+#ifndef V4L2_CID_ASPEED_JPEG_REGIONS
+#define V4L2_CID_ASPEED_JPEG_REGIONS (V4L2_CID_USER_ASPEED_BASE + 8)
+#endif
+
+namespace ikvm
+{
+/*
+ * @class VideoSource
+ * @brief Interface of a source of captured video frames consumed by the RFB
+ *        server: the V4L2 video engine or a recorded sequence
+ */
+class VideoSource
+{
+  public:
+    /* @brief Most changed regions reported for a partial-jpeg frame */
+    static constexpr unsigned int maxRegions = 16;
+
+    /*
+     * @struct Region
+     * @brief Changed area of a partial-jpeg frame and where its jpeg lies in
+     *        the frame data, laid out as the driver reports it
+     */
+    struct Region
+    {
+        /* @brief Screen area of the jpeg */
+        v4l2_rect box;
+        /* @brief Offset of the jpeg in the frame data */
+        uint32_t offset;
+        /* @brief Number of bytes of the jpeg */
+        uint32_t size;
+    };
+
+    /*
+     * @struct Update
+     * @brief Copy of the jpegs of a partial-jpeg frame
+     */
+    struct Update
+    {
+        /* @brief Jpegs of the frame, back to back */
+        std::vector<char> data;
+        /* @brief Screen areas of the jpegs, offsets into data */
+        std::vector<Region> regions;
+    };
+
+    /* @brief Partial-jpeg frames, oldest first */
+    using Updates = std::vector<std::shared_ptr<const Update>>;
+
+    /*
+     * @struct Frame
+     * @brief Describes a captured frame waiting to be sent
+     */
+    struct Frame
+    {
+        /* @brief Index of the buffer holding the frame */
+        unsigned int index;
+        /* @brief Pointer to the frame data */
+        char* data;
+        /* @brief Number of bytes of frame data */
+        size_t payload;
+        /* @brief Sequence number of the frame */
+        uint32_t sequence;
+        /* @brief Bounding-box of a partial-jpeg frame */
+        v4l2_rect box;
+        /* @brief Number of RFB rectangles of a hextile frame */
+        unsigned int rects;
+        /*
+         * @brief Changed regions of a partial-jpeg frame, nullptr when the
+         *        frame is a single jpeg of the bounding-box
+         */
+        const Region* regions;
+        /* @brief Number of changed regions */
+        unsigned int regionCount;
+        /*
+         * @brief Layout of a jpeg frame; of the first jpeg of a frame with
+         *        changed regions, valid only if every one of them is
+         */
+        JpegInfo jpeg;
+        /*
+         * @brief CRC-32 of the frame data from the entropy-coded data on,
+         *        -1 when frames are not hashed
+         */
+        int64_t crc;
+        /* @brief Time the frame was captured */
+        std::chrono::steady_clock::time_point timestamp;
+    };
+
+    VideoSource() = default;
+    virtual ~VideoSource() = default;
+    VideoSource(const VideoSource&) = default;
+    VideoSource& operator=(const VideoSource&) = default;
+    VideoSource(VideoSource&&) = default;
+    VideoSource& operator=(VideoSource&&) = default;
+
+    /* @brief Grabs the next frame unless the current one isn't sent yet */
+    virtual void getFrame() = 0;
+    /* @brief Releases the frames that have been sent */
+    virtual void releaseFrames() = 0;
+    /*
+     * @brief Describes the oldest captured frame not yet released
+     *
+     * @param[out] frame - Descriptor of the frame
+     *
+     * @return Boolean indicating if there is a frame to send
+     */
+    virtual bool getCurrentFrame(Frame& frame) const = 0;
+    /*
+     * @brief Accounts the current frame as sent
+     *
+     * @param[in] backlog - Largest number of bytes still queued to a client
+     */
+    virtual void frameSent(size_t backlog) = 0;
+    /*
+     * @brief Accounts the current frame as skipped because it is identical
+     *        to the previous one
+     */
+    virtual void frameUnchanged() = 0;
+    /*
+     * @brief Accounts the current frame as skipped because its jpeg data is
+     *        truncated
+     */
+    virtual void frameTruncated() = 0;
+    /*
+     * @brief Asks for the next frame to cover the whole screen, for sources
+     *        that otherwise only capture what changed
+     */
+    virtual void requestFullFrame() = 0;
+    /*
+     * @brief Gets whether the partial-jpeg frames are composited into a full
+     *        screen, so that a keyframe can be had shortly
+     *
+     * @return Boolean indicating if the composite covers the screen
+     */
+    virtual bool hasKeyframe() = 0;
+    /*
+     * @brief Gets the last full screen jpeg composited from the partial-jpeg
+     *        frames without waiting for the compositing, along with the
+     *        frames captured after it, the current one included
+     *
+     * @param[out] jpeg    - Full screen jpeg
+     * @param[out] updates - Frames that bring the jpeg up to date
+     *
+     * @return Boolean indicating if there is a keyframe
+     */
+    virtual bool getKeyframe(std::vector<char>& jpeg, Updates& updates) = 0;
+    /*
+     * @brief Gets whether or not the video frame needs to be resized
+     *
+     * @return Boolean indicating if the frame needs to be resized
+     */
+    virtual bool needsResize() = 0;
+    /* @brief Performs the resize and re-allocates framebuffer */
+    virtual void resize() = 0;
+    /* @brief Starts producing frames */
+    virtual void start() = 0;
+    /* @brief Stops producing frames */
+    virtual void stop() = 0;
+    /*
+     * @brief Gets the desired video frame rate in frames per second
+     *
+     * @return Value of the desired frame rate
+     */
+    virtual int getFrameRate() const = 0;
+    /*
+     * @brief Gets the height of the video frame
+     *
+     * @return Value of the height of video frame in pixels
+     */
+    virtual size_t getHeight() const = 0;
+    /*
+     * @brief Gets the width of the video frame
+     *
+     * @return Value of the width of video frame in pixels
+     */
+    virtual size_t getWidth() const = 0;
+    /*
+     * @brief Gets the pixel format of the video frame
+     *
+     * @return Value of the pixel format of video frame
+     */
+    virtual uint32_t getPixelformat() const = 0;
+    /*
+     * @brief Gets the jpeg format of the video frame
+     *
+     * @return Value of the jpeg format of video frame
+     *         0:standard jpeg, 1:aspeed jpeg, 2:partial jpeg, 3:hextile
+     */
+    virtual int getFormat() const = 0;
+    /*
+     * @brief Gets the jpeg format the source was configured with
+     *
+     * @return Value of the jpeg format of video frame
+     *         0:standard jpeg, 1:aspeed jpeg, 2:partial jpeg, 3:hextile
+     */
+    virtual int getOriginalFormat() const = 0;
+    /*
+     * @brief Switches the jpeg format of the video frame
+     *
+     * @param[in] newformat - jpeg format to switch to
+     */
+    virtual void formatChange(int newformat) = 0;
+    /*
+     * @brief Copies the current frame as an image
+     *
+     * @param[out] image - jpeg data of the image
+     *
+     * @return Boolean indicating if an image was taken
+     */
+    virtual bool screenShot(std::vector<char>& image) = 0;
+    /*
+     * @brief Saves the frames captured shortly before as a frame log
+     *
+     * @param[in] path - Path to the frame log
+     */
+    virtual void saveRecentFrames(const std::string& path) = 0;
+    /*
+     * @brief Gets whether frames are kept to be saved when the host crashes
+     *
+     * @return Boolean indicating if saveRecentFrames has frames to save
+     */
+    virtual bool keepsFrames() const = 0;
+    /*
+     * @brief Captures at a low rate while frames are only kept for a host
+     *        crash, with nobody watching them
+     *
+     * @param[in] idle - Boolean indicating if nobody takes the frames
+     */
+    virtual void setUnattended(bool idle) = 0;
+    /*
+     * @brief Starts or stops hashing every frame as it is captured, for
+     *        skipping the frames identical to the previous one
+     *
+     * @param[in] enable - Boolean indicating if frames are to be hashed
+     */
+    virtual void hashFrames(bool enable) = 0;
+
+    /* @brief Number of bits per component of a pixel */
+    static const int bitsPerSample;
+    /* @brief Number of bytes of storage for a pixel */
+    static const int bytesPerPixel;
+    /* @brief Number of components in a pixel (i.e. 3 for RGB pixel) */
+    static const int samplesPerPixel;
+};
+
+} // namespace ikvm
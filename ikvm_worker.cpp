@@ -0,0 +1,36 @@
+#include "ikvm_worker.hpp"
+
+namespace ikvm
+{
+
+Worker::Worker() : stopping(false) {}
+
+Worker::~Worker()
+{
+    stop();
+}
+
+void Worker::start(std::function<void()>&& body)
+{
+    if (!stopping && !thread.joinable())
+    {
+        thread = std::thread(std::move(body));
+    }
+}
+
+void Worker::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        stopping = true;
+    }
+    cv.notify_all();
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+} // namespace ikvm
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace ikvm
+{
+/*
+ * @class Worker
+ * @brief Background thread started on first use, along with the mutex and
+ *        condition variable its owner hands work over with. stop() asks
+ *        the thread to exit and joins it; owners call it before tearing
+ *        down anything the thread uses.
+ */
+class Worker
+{
+  public:
+    Worker();
+    ~Worker();
+    Worker(const Worker&) = delete;
+    Worker& operator=(const Worker&) = delete;
+    Worker(Worker&&) = delete;
+    Worker& operator=(Worker&&) = delete;
+
+    /*
+     * @brief Gets the mutex guarding the work handed to the thread
+     *
+     * @return Mutex of the worker
+     */
+    inline std::mutex& mutex()
+    {
+        return lock;
+    }
+    /*
+     * @brief Starts the thread unless it was started already; called with
+     *        the mutex held
+     *
+     * @param[in] body - Loop of the thread, returning once wait() fails
+     */
+    void start(std::function<void()>&& body);
+    /* @brief Wakes the thread up to look for work */
+    inline void notify()
+    {
+        cv.notify_all();
+    }
+    /*
+     * @brief Waits on the thread for work or for being stopped
+     *
+     * @param[in] ulock - Lock held on the mutex
+     * @param[in] ready - Returns whether there is work
+     *
+     * @return Boolean indicating if there is work, false once stopped
+     */
+    template <typename Predicate>
+    bool wait(std::unique_lock<std::mutex>& ulock, Predicate ready)
+    {
+        cv.wait(ulock, [this, &ready] { return stopping || ready(); });
+        return !stopping;
+    }
+    /* @brief Asks the thread to exit and waits for it */
+    void stop();
+
+  private:
+    /* @brief Guards the work handed to the thread */
+    std::mutex lock;
+    /* @brief Signals work or the thread having to exit */
+    std::condition_variable cv;
+    /* @brief The thread has to exit */
+    bool stopping;
+    /* @brief Runs the loop of the owner */
+    std::thread thread;
+};
+
+/*
+ * @class WorkQueue
+ * @brief Runs jobs one at a time on a Worker. The queue is bounded so that
+ *        the thread handing jobs over never waits; when it is full either
+ *        the oldest job or the new one is dropped. Jobs still queued when
+ *        the queue is stopped are run on the way out.
+ */
+template <typename Job>
+class WorkQueue
+{
+  public:
+    /* @brief Runs a job on the worker thread, without the mutex held */
+    using Handler = std::function<void(Job& job)>;
+
+    /* @brief Job dropped when the queue is full */
+    enum class Drop
+    {
+        Oldest,
+        Newest
+    };
+
+    /*
+     * @brief Constructs WorkQueue object
+     *
+     * @param[in] h     - Runs the jobs
+     * @param[in] jobs  - Most jobs waiting
+     * @param[in] d     - Job dropped when the queue is full
+     * @param[in] bytes - Most bytes of jobs waiting or running, 0 for no
+     *                    limit
+     */
+    WorkQueue(Handler&& h, size_t jobs, Drop d, size_t bytes = 0) :
+        handler(std::move(h)), maxJobs(jobs), drop(d), maxBytes(bytes),
+        queuedBytes(0)
+    {}
+    ~WorkQueue()
+    {
+        stop();
+    }
+    WorkQueue(const WorkQueue&) = delete;
+    WorkQueue& operator=(const WorkQueue&) = delete;
+    WorkQueue(WorkQueue&&) = delete;
+    WorkQueue& operator=(WorkQueue&&) = delete;
+
+    /*
+     * @brief Gets whether a job would be queued without dropping one
+     *
+     * @param[in] bytes - Size of the job
+     *
+     * @return Boolean indicating if there is room for the job
+     */
+    bool room(size_t bytes = 0)
+    {
+        std::lock_guard<std::mutex> guard(worker.mutex());
+
+        return fits(bytes);
+    }
+    /*
+     * @brief Queues a job, starting the worker thread on first use
+     *
+     * @param[in] job   - Job to run
+     * @param[in] bytes - Size of the job
+     *
+     * @return Boolean indicating if the job was queued without dropping one
+     */
+    bool push(Job&& job, size_t bytes = 0)
+    {
+        bool dropped = false;
+
+        {
+            std::lock_guard<std::mutex> guard(worker.mutex());
+
+            if (!fits(bytes))
+            {
+                if (drop == Drop::Newest)
+                {
+                    return false;
+                }
+
+                while (!jobs.empty() && !fits(bytes))
+                {
+                    queuedBytes -= jobs.front().second;
+                    jobs.pop_front();
+                }
+                dropped = true;
+            }
+
+            jobs.emplace_back(std::move(job), bytes);
+            queuedBytes += bytes;
+
+            worker.start([this] { run(); });
+        }
+        worker.notify();
+
+        return !dropped;
+    }
+    /* @brief Runs the queued jobs and stops the worker thread */
+    inline void stop()
+    {
+        worker.stop();
+    }
+
+  private:
+    /*
+     * @brief Gets whether a job fits in the queue, with the mutex held
+     *
+     * @param[in] bytes - Size of the job
+     *
+     * @return Boolean indicating if there is room for the job
+     */
+    bool fits(size_t bytes) const
+    {
+        return jobs.size() < maxJobs &&
+               (!maxBytes || queuedBytes + bytes <= maxBytes);
+    }
+    /* @brief Runs the queued jobs until stopped */
+    void run()
+    {
+        std::unique_lock<std::mutex> ulock(worker.mutex());
+
+        while (true)
+        {
+            worker.wait(ulock, [this] { return !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+
+            auto job = std::move(jobs.front());
+
+            jobs.pop_front();
+            ulock.unlock();
+            handler(job.first);
+            ulock.lock();
+
+            // A running job still counts, so the bytes held stay bounded
+            queuedBytes -= job.second;
+        }
+    }
+
+    /* @brief Runs the jobs */
+    Handler handler;
+    /* @brief Most jobs waiting */
+    const size_t maxJobs;
+    /* @brief Job dropped when the queue is full */
+    const Drop drop;
+    /* @brief Most bytes of jobs waiting or running, 0 for no limit */
+    const size_t maxBytes;
+    /* @brief Jobs waiting, with their size */
+    std::deque<std::pair<Job, size_t>> jobs;
+    /* @brief Bytes of jobs waiting or running */
+    size_t queuedBytes;
+    /* @brief Runs the jobs */
+    Worker worker;
+};
+
+} // namespace ikvm